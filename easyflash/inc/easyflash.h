@@ -48,7 +48,23 @@ EfErrCode easyflash_init(void);
 size_t ef_get_env_blob(const char *key, void *value_buf, size_t buf_len, size_t *saved_value_len);
 bool ef_get_env_obj(const char *key, env_node_obj_t env);
 size_t ef_read_env_value(env_node_obj_t env, uint8_t *value_buf, size_t buf_len);
+size_t ef_read_env_value_at(env_node_obj_t env, size_t offset, uint8_t *value_buf, size_t buf_len);
+const void *ef_get_env_ptr(const char *key, size_t *value_len);
+env_iterator_obj_t ef_env_iter_init(env_iterator_obj_t itr, const char *prefix);
+bool ef_env_iter_next(env_iterator_obj_t itr);
+void ef_release_env_ptr(const void *value);
 EfErrCode ef_set_env_blob(const char *key, const void *value_buf, size_t buf_len);
+EfErrCode ef_env_counter_inc(const char *key, uint32_t *value);
+EfErrCode ef_set_env_batch(const ef_env *env_set, size_t env_num);
+EfErrCode ef_set_env_stream_open(const char *key, size_t value_len);
+EfErrCode ef_set_env_stream_write(const void *value_buf, size_t buf_len);
+EfErrCode ef_set_env_stream_close(void);
+void ef_get_env_bloom_stats(env_bloom_stats_t stats);
+void ef_get_env_read_cache_stats(env_read_cache_stats_t stats);
+void ef_env_cache_scrub(void);
+bool ef_env_gc_step(size_t max_bytes);
+EfErrCode ef_set_env_hint(const char *key, EfEnvHint hint);
+void ef_get_env_wear_stats(env_wear_stats_t stats);
 
 /* ef_env.c, ef_env_legacy_wl.c and ef_env_legacy.c */
 EfErrCode ef_load_env(void);
@@ -84,6 +100,21 @@ uint32_t ef_get_bak_app_start_addr(void);
 EfErrCode ef_log_read(size_t index, uint32_t *log, size_t size);
 EfErrCode ef_log_write(const uint32_t *log, size_t size);
 EfErrCode ef_log_clean(void);
+EfErrCode ef_log_flush(void);
+EfErrCode ef_log_flush_expired(void);
+EfErrCode ef_log_flush_emergency(void);
+EfErrCode ef_log_ring_write(const uint32_t *log, size_t size);
+EfErrCode ef_log_ring_drain(void);
+void ef_get_log_ring_stats(log_ring_stats_t stats);
+EfErrCode ef_log_pre_erase(void);
+#ifdef EF_LOG_USING_RECORD
+EfErrCode ef_log_record_write(const void *data, size_t size);
+log_iterator_obj_t ef_log_iter_init(log_iterator_obj_t itr, bool from_newest);
+bool ef_log_iter_next(log_iterator_obj_t itr);
+bool ef_log_iter_prev(log_iterator_obj_t itr);
+bool ef_log_iter_seek(log_iterator_obj_t itr, uint32_t seq);
+size_t ef_log_iter_read(log_iterator_obj_t itr, void *buf, size_t size);
+#endif
 size_t ef_log_get_used_size(void);
 size_t ef_log_get_total_size(void);
 #endif
@@ -44,6 +44,101 @@
 /* MCU Endian Configuration, default is Little Endian Order. */
 /* #define EF_BIG_ENDIAN  */         
 
+/**
+ * The ENV index table size, it's an in-RAM hash table for all ENV address, every slot will cost 8 bytes RAM.
+ * The slots number should be greater than the ENV number. The ENV find will NOT traverse the flash when enabled.
+ */
+/* #define EF_ENV_INDEX_TABLE_SIZE   256 */
+
+/**
+ * The bits per ENV of the negative lookup bloom filter. The not exist ENV will be returned without read flash.
+ * It will cost (EF_ENV_BLOOM_BITS_PER_KEY * EF_ENV_BLOOM_KEY_NUM / 8) bytes RAM.
+ */
+/* #define EF_ENV_BLOOM_BITS_PER_KEY 10 */
+/* the max ENV number which the bloom filter designed for */
+/* #define EF_ENV_BLOOM_KEY_NUM      128 */
+
+/**
+ * The read cache page number, it's a LRU page cache in front of ef_port_read. The small flash reads of ENV will be
+ * merged to page reads, it's useful for the flash which every read has a long latency (such as SPI flash).
+ * It will cost (EF_ENV_READ_CACHE_PAGE_NUM * (EF_ENV_READ_CACHE_PAGE_SIZE + 8)) bytes RAM.
+ */
+/* #define EF_ENV_READ_CACHE_PAGE_NUM 4 */
+/* the read cache page size, it must be a power of 2 and less than or equal to sector size */
+/* #define EF_ENV_READ_CACHE_PAGE_SIZE 256 */
+
+/**
+ * Using the in-RAM sector allocation map. The ENV alloc will NOT traverse the flash when enabled.
+ * It will cost (20 * sector number) bytes RAM.
+ */
+/* #define EF_ENV_USING_SECTOR_MAP */
+
+/* the copy buffer size of GC moving ENV, it must be aligned by 8. Larger numbers can speed up GC with more stack */
+/* #define EF_GC_COPY_BUF_SIZE       32 */
+
+/**
+ * The staging buffer size of the new ENV write, it must be aligned by 8. The ENV header, name and value will be merged
+ * into the buffer and written by one ef_port_write call per program page, so the flash write number will be less.
+ */
+/* #define EF_ENV_WRITE_BUF_SIZE     64 */
+/* the flash program page size, it must be a power of 2. The buffered ENV write will NOT cross the page boundary */
+/* #define EF_WRITE_PAGE_SIZE        256 */
+
+/**
+ * The incremental GC step (ef_env_gc_step) will collect the dirty sector when the empty sector number is less than
+ * or equal to it. It must be greater than or equal to EF_GC_EMPTY_SEC_THRESHOLD (default 1).
+ */
+/* #define EF_GC_STEP_EMPTY_SEC_THRESHOLD 2 */
+
+/**
+ * The GC victim sector selection policy.
+ * EF_GC_POLICY_ALL: collect all dirty sectors by address order. It's the default policy.
+ * EF_GC_POLICY_GREEDY: collect the sector which has the most dead bytes per live bytes first,
+ *                      and stop when the empty sector reserve has been restored.
+ * EF_GC_POLICY_COST_BENEFIT: same as greedy, the sector which NOT written for a long time is preferred.
+ *                            It must using the sector map (EF_ENV_USING_SECTOR_MAP).
+ */
+/* #define EF_GC_POLICY              EF_GC_POLICY_GREEDY */
+
+/**
+ * The ENV hot table size, it records the update frequency of ENV, every slot will cost 8 bytes RAM.
+ * The hot ENV (updated frequently or hinted by ef_set_env_hint) will be written to a separate open sector,
+ * and the GC moved ENV will be written to the cold open sector. So the GC will copy less cold data.
+ */
+/* #define EF_ENV_HOT_TABLE_SIZE     16 */
+
+/* the max ENV number of an atomic batch write (ef_set_env_batch), every ENV will cost 4 bytes stack */
+/* #define EF_ENV_BATCH_MAX          64 */
+
+/**
+ * The increment step number of a counter ENV (ef_env_counter_inc). Every increment only marks one step in place,
+ * and the counter ENV will be rewritten when all steps are marked. Every step will cost 1 bit (EF_WRITE_GRAN is 1)
+ * or (EF_WRITE_GRAN / 8) bytes flash on the counter ENV.
+ */
+/* #define EF_ENV_COUNTER_STEPS      64 */
+
+/**
+ * Compress the ENV value by a built-in small LZ77 codec when it's stored. The compressed value will be decompressed
+ * when it's read, and it will NOT be compressed when the flash space can NOT be saved. The chunk by chunk read
+ * (ef_read_env_value_at) is resumed from last chunk. It will cost (550 + EF_READ_BUF_SIZE) bytes RAM.
+ */
+/* #define EF_ENV_USING_COMPRESS */
+
+/**
+ * The ENV area is memory mapped (such as the MCU on-chip flash), so the ENV value can be used in place by
+ * ef_get_env_ptr. The sector which has unreleased ENV pointer will NOT be collected by GC.
+ * EF_ENV_XIP_ADDR(addr) converts the flash address to the mapped address, default is same as flash address.
+ */
+/* #define EF_ENV_USING_XIP */
+/* the max number of unreleased ENV pointer, every one will cost 4 bytes RAM */
+/* #define EF_ENV_PIN_TABLE_SIZE     4 */
+
+/**
+ * Using the scalar flash scan of continue_ff_addr and find_next_env_addr. The data is checked byte by byte and the
+ * magic word is searched on every byte offset. It's slower than the default word scan, only for comparison.
+ */
+/* #define EF_SCAN_USING_SCALAR */
+
 #endif /* EF_USING_ENV */
 
 /* using IAP function */
@@ -52,6 +147,40 @@
 /* using save log function */
 /* #define EF_USING_LOG */
 
+#ifdef EF_USING_LOG
+/**
+ * The log staging buffer size, it must be a power of 2 and less than or equal to EF_ERASE_MIN_SIZE. The logs will be
+ * put into the RAM buffer first, and it's written to flash by page (buffer size aligned) when the buffer is full.
+ * The logs on buffer will be lost when the power is down, @see ef_log_flush and ef_log_flush_emergency
+ */
+/* #define EF_LOG_WRITE_BUF_SIZE     256 */
+/* the max latency (unit: tick) of the logs on staging buffer, it's checked on ef_log_write and ef_log_flush_expired */
+/* #define EF_LOG_WRITE_BUF_LATENCY  100 */
+/* get the current tick for the log staging buffer latency, such as rt_tick_get() on RT-Thread */
+/* #define EF_LOG_GET_TICK()         rt_tick_get() */
+
+/**
+ * The lock-free log ring size, it must be a power of 2. The tasks and ISRs can put log to the ring by
+ * ef_log_ring_write without blocking, and the logs will be written to flash by ef_log_ring_drain on one consumer.
+ * Every log costs 4 bytes header on ring. The default atomic operation is GCC __sync builtins, it can be replaced by
+ * EF_LOG_ATOMIC_CAS(ptr, old, new) and EF_LOG_MEMORY_BARRIER().
+ */
+/* #define EF_LOG_RING_SIZE          1024 */
+
+/**
+ * The pre-erased sector number after the USING sector by ef_log_pre_erase. The pre-erased sectors can NOT save log,
+ * so the oldest logs on them will be dropped. It must be less than the log sector number.
+ */
+/* #define EF_LOG_PRE_ERASE_SEC_NUM  1 */
+
+/**
+ * Using the record mode of log. Every record written by ef_log_record_write has the length, CRC32 and sequence number,
+ * so the record size is NOT required to be word aligned. The records can be iterated forward or backward, and seek by
+ * the sequence number, @see ef_log_iter_next. Every record costs 16 bytes frame and the padding to word alignment.
+ */
+/* #define EF_LOG_USING_RECORD */
+#endif /* EF_USING_LOG */
+
 /* The minimum size of flash erasure. May be a flash sector size. */
 #define EF_ERASE_MIN_SIZE         /* @note you must define it for a value */
 
@@ -60,7 +189,7 @@
 #define EF_WRITE_GRAN             /* @note you must define it for a value */
 
 
-/* The size of read_env and continue_ff_addr function used*/
+/* The size of read_env, continue_ff_addr and find_next_env_addr function used, it must be aligned by 8 */
 #define EF_READ_BUF_SIZE             32     /* @default 32, Larger numbers can improve first-time speed of alloc_env but require more stack space*/
 /*
  *
@@ -50,6 +50,11 @@ extern "C" {
 #define EF_ENV_NAME_MAX                          32
 #endif
 
+/* the GC victim sector selection policy, @see EF_GC_POLICY on ef_cfg.h */
+#define EF_GC_POLICY_ALL               0
+#define EF_GC_POLICY_GREEDY            1
+#define EF_GC_POLICY_COST_BENEFIT      2
+
 /* EasyFlash debug print function. Must be implement by user. */
 #ifdef PRINT_DEBUG
 #define EF_DEBUG(...) ef_log_debug(__FILE__, __LINE__, __VA_ARGS__)
@@ -91,6 +96,13 @@ typedef enum {
     EF_SECTOR_FULL,
 } EfSecrorStatus;
 
+/* the ENV update frequency hint, @see ef_set_env_hint */
+typedef enum {
+    EF_ENV_HINT_AUTO,                            /**< judged by the observed update frequency */
+    EF_ENV_HINT_HOT,                             /**< the ENV is updated frequently, such as counter */
+    EF_ENV_HINT_COLD,                            /**< the ENV is rarely updated, such as calibration data */
+} EfEnvHint;
+
 enum env_status {
     ENV_UNUSED,
     ENV_PRE_WRITE,
@@ -105,10 +117,13 @@ typedef enum env_status env_status_t;
 struct env_node_obj {
     env_status_t status;                         /**< ENV node status, @see node_status_t */
     bool crc_is_ok;                              /**< ENV node CRC32 check is OK */
+    bool crc_is_deferred;                        /**< ENV node CRC32 check is deferred, only header and name has been read */
+    bool is_compressed;                          /**< ENV value is compressed on flash, the value_len is the original length */
     uint8_t name_len;                            /**< name length */
     uint32_t magic;                              /**< magic word(`K`, `V`, `4`, `0`) */
     uint32_t len;                                /**< ENV node total length (header + name + value), must align by EF_WRITE_GRAN */
     uint32_t value_len;                          /**< value length */
+    uint32_t crc32;                              /**< ENV node crc32(name_len + data_len + name + value) */
     char name[EF_ENV_NAME_MAX];                  /**< name */
     struct {
         uint32_t start;                          /**< ENV node start address */
@@ -117,6 +132,59 @@ struct env_node_obj {
 };
 typedef struct env_node_obj *env_node_obj_t;
 
+struct env_iterator_obj {
+    struct env_node_obj curr_env;                /**< current ENV, the name is NOT '\0' terminated */
+    const char *prefix;                          /**< the ENV name prefix filter, NULL: all ENV */
+    size_t prefix_len;                           /**< the ENV name prefix length */
+    uint32_t sector_addr;                        /**< current iterating sector address, 0xFFFFFFFF: iterating is finished */
+};
+typedef struct env_iterator_obj *env_iterator_obj_t;
+
+struct env_bloom_stats {
+    size_t bits;                                 /**< bloom filter total bits, 0: the bloom filter is disabled */
+    size_t hash_num;                             /**< hash function number */
+    size_t keys;                                 /**< the ENV number which has been added to filter */
+    size_t stale;                                /**< the deleted ENV number which is still in filter */
+    uint32_t query;                              /**< total query times */
+    uint32_t reject;                             /**< the ENV is definitely NOT on flash times, it's NOT read flash */
+    uint32_t false_positive;                     /**< the ENV passed the filter but NOT found on flash times */
+    uint32_t rebuild;                            /**< the filter rebuild times */
+};
+typedef struct env_bloom_stats *env_bloom_stats_t;
+
+struct env_read_cache_stats {
+    size_t pages;                                /**< read cache page number, 0: the read cache is disabled */
+    size_t page_size;                            /**< read cache page size */
+    uint32_t hit;                                /**< the read is served by cached page times */
+    uint32_t miss;                               /**< the page is loaded from flash times */
+};
+typedef struct env_read_cache_stats *env_read_cache_stats_t;
+
+struct env_wear_stats {
+    size_t sectors;                              /**< the ENV sector number */
+    uint32_t min;                                /**< the minimum sector erase count */
+    uint32_t max;                                /**< the maximum sector erase count */
+    uint32_t mean;                               /**< the mean sector erase count */
+};
+typedef struct env_wear_stats *env_wear_stats_t;
+
+struct log_ring_stats {
+    size_t size;                                 /**< log ring buffer size, 0: the log ring is disabled */
+    size_t used;                                 /**< the current used size, includes the record headers */
+    size_t high_water;                           /**< the max used size since initialize */
+    uint32_t dropped;                            /**< the dropped log number because the ring is full */
+    uint32_t dropped_bytes;                      /**< the dropped log bytes */
+};
+typedef struct log_ring_stats *log_ring_stats_t;
+
+struct log_iterator_obj {
+    size_t cursor;                               /**< iterating position on log, it's between the records */
+    size_t index;                                /**< current record start index on log, @see ef_log_read */
+    size_t len;                                  /**< current record data length */
+    uint32_t seq;                                /**< current record sequence number */
+};
+typedef struct log_iterator_obj *log_iterator_obj_t;
+
 #ifdef __cplusplus
 }
 #endif
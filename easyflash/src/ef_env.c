@@ -64,6 +64,11 @@
 #define EF_GC_EMPTY_SEC_THRESHOLD                1
 #endif
 
+/* the total remain empty sector threshold before incremental GC step, @see ef_env_gc_step */
+#ifndef EF_GC_STEP_EMPTY_SEC_THRESHOLD
+#define EF_GC_STEP_EMPTY_SEC_THRESHOLD           (EF_GC_EMPTY_SEC_THRESHOLD + 1)
+#endif
+
 /* the ENV cache table size, it will improve ENV search speed when using cache */
 #ifndef EF_ENV_CACHE_TABLE_SIZE
 #define EF_ENV_CACHE_TABLE_SIZE                  16
@@ -82,6 +87,137 @@
 #define EF_ENV_USING_CACHE
 #endif
 
+/* the GC victim sector selection policy */
+#ifndef EF_GC_POLICY
+#define EF_GC_POLICY                             EF_GC_POLICY_ALL
+#endif
+
+#if (EF_GC_POLICY == EF_GC_POLICY_COST_BENEFIT) && !defined(EF_ENV_USING_SECTOR_MAP)
+#error "the EF_GC_POLICY_COST_BENEFIT must using the sector map (EF_ENV_USING_SECTOR_MAP)"
+#endif
+
+/* the max sector age for cost-benefit GC policy, the age is how many sectors has been full after last written */
+#ifndef EF_GC_AGE_MAX
+#define EF_GC_AGE_MAX                            15
+#endif
+
+/* the copy buffer size when GC move the ENV to new sector, it must be aligned by 8 */
+#ifndef EF_GC_COPY_BUF_SIZE
+#define EF_GC_COPY_BUF_SIZE                      32
+#endif
+
+#if (EF_GC_COPY_BUF_SIZE < 8) || (EF_GC_COPY_BUF_SIZE % 8 != 0)
+#error "the GC copy buffer size must be aligned by 8"
+#endif
+
+/* the staging buffer size when create ENV, the ENV header, name and value are merged on it, it must be aligned by 8 */
+#ifndef EF_ENV_WRITE_BUF_SIZE
+#define EF_ENV_WRITE_BUF_SIZE                    64
+#endif
+
+#if (EF_ENV_WRITE_BUF_SIZE < 8) || (EF_ENV_WRITE_BUF_SIZE % 8 != 0)
+#error "the ENV write buffer size must be aligned by 8"
+#endif
+
+/* the flash program page size, the staging buffer write will NOT cross the page boundary, it must be a power of 2 */
+#ifndef EF_WRITE_PAGE_SIZE
+#define EF_WRITE_PAGE_SIZE                       256
+#endif
+
+#if (EF_WRITE_PAGE_SIZE < 8) || (EF_WRITE_PAGE_SIZE & (EF_WRITE_PAGE_SIZE - 1)) != 0
+#error "the write page size must be a power of 2"
+#endif
+
+/* the ENV hot table size, it records the ENV update frequency for hot/cold ENV segregation. 0: disable */
+#ifndef EF_ENV_HOT_TABLE_SIZE
+#define EF_ENV_HOT_TABLE_SIZE                    0
+#endif
+
+/* the ENV is hot when its update times is greater than or equal to the threshold */
+#ifndef EF_ENV_HOT_THRESHOLD
+#define EF_ENV_HOT_THRESHOLD                     2
+#endif
+
+#if EF_ENV_HOT_TABLE_SIZE > 0
+#define EF_ENV_USING_HOT_COLD
+#endif
+
+/* the max ENV number of an atomic batch write, @see ef_set_env_batch */
+#ifndef EF_ENV_BATCH_MAX
+#define EF_ENV_BATCH_MAX                         64
+#endif
+
+#ifdef EF_ENV_USING_COMPRESS
+/* the compressed value is the LZ77 tokens, the match distance is less than or equal to window size */
+#define ENV_COMPRESS_WINDOW                      256
+#define ENV_COMPRESS_MIN_MATCH                   3
+#define ENV_COMPRESS_MAX_MATCH                   (0x7F + ENV_COMPRESS_MIN_MATCH)
+#define ENV_COMPRESS_MAX_LITERAL                 0x80
+/* the compress hash table will cost (4 * 2^ENV_COMPRESS_HASH_BITS) bytes RAM */
+#define ENV_COMPRESS_HASH_BITS                   6
+#endif /* EF_ENV_USING_COMPRESS */
+
+/* the increment step number of a counter ENV before it's rewritten, @see ef_env_counter_inc */
+#ifndef EF_ENV_COUNTER_STEPS
+#define EF_ENV_COUNTER_STEPS                     64
+#endif
+
+#ifdef EF_ENV_USING_XIP
+/* the pin table size, it's the max number of ENV value pointer which is NOT released, @see ef_get_env_ptr */
+#ifndef EF_ENV_PIN_TABLE_SIZE
+#define EF_ENV_PIN_TABLE_SIZE                    4
+#endif
+/* convert the flash address to the memory mapped address */
+#ifndef EF_ENV_XIP_ADDR
+#define EF_ENV_XIP_ADDR(addr)                    ((const void *)(uintptr_t)(addr))
+#endif
+#endif /* EF_ENV_USING_XIP */
+
+/* the read cache page number, it's a LRU page cache in front of ef_port_read. 0: disable */
+#ifndef EF_ENV_READ_CACHE_PAGE_NUM
+#define EF_ENV_READ_CACHE_PAGE_NUM               0
+#endif
+
+/* the read cache page size, it must be a power of 2 and less than or equal to sector size */
+#ifndef EF_ENV_READ_CACHE_PAGE_SIZE
+#define EF_ENV_READ_CACHE_PAGE_SIZE              256
+#endif
+
+#if EF_ENV_READ_CACHE_PAGE_NUM > 0
+#define EF_ENV_USING_READ_CACHE
+#if (EF_ENV_READ_CACHE_PAGE_SIZE < 8) || (EF_ENV_READ_CACHE_PAGE_SIZE & (EF_ENV_READ_CACHE_PAGE_SIZE - 1)) != 0
+#error "the read cache page size must be a power of 2"
+#endif
+#endif
+
+/* the ENV index table size, it's an open addressing hash table for all ENV address. 0: disable */
+#ifndef EF_ENV_INDEX_TABLE_SIZE
+#define EF_ENV_INDEX_TABLE_SIZE                  0
+#endif
+
+#if EF_ENV_INDEX_TABLE_SIZE > 0
+#define EF_ENV_USING_INDEX
+#endif
+
+/* the bits per ENV of the negative lookup bloom filter. 0: disable */
+#ifndef EF_ENV_BLOOM_BITS_PER_KEY
+#define EF_ENV_BLOOM_BITS_PER_KEY                0
+#endif
+
+/* the max ENV number which the bloom filter designed for */
+#ifndef EF_ENV_BLOOM_KEY_NUM
+#define EF_ENV_BLOOM_KEY_NUM                     128
+#endif
+
+#if EF_ENV_BLOOM_BITS_PER_KEY > 0
+#define EF_ENV_USING_BLOOM
+/* the bloom filter total bits */
+#define ENV_BLOOM_BITS                           (EF_ALIGN(EF_ENV_BLOOM_BITS_PER_KEY * EF_ENV_BLOOM_KEY_NUM, 8))
+/* the best hash function number is (bits per key * ln2) */
+#define ENV_BLOOM_HASH_NUM                       ((EF_ENV_BLOOM_BITS_PER_KEY * 69 + 50) / 100 > 0 ? \
+                                                  (EF_ENV_BLOOM_BITS_PER_KEY * 69 + 50) / 100 : 1)
+#endif
+
 /* the sector is not combined value */
 #define SECTOR_NOT_COMBINED                      0xFFFFFFFF
 /* the next address is get failed */
@@ -118,18 +254,40 @@
 #error "The sector number must lager then or equal to 2"
 #endif
 
+#if (EF_GC_STEP_EMPTY_SEC_THRESHOLD < EF_GC_EMPTY_SEC_THRESHOLD)
+#error "EF_GC_STEP_EMPTY_SEC_THRESHOLD must be greater than or equal to EF_GC_EMPTY_SEC_THRESHOLD"
+#endif
+
 #if (EF_GC_EMPTY_SEC_THRESHOLD == 0 || EF_GC_EMPTY_SEC_THRESHOLD >= SECTOR_NUM)
 #error "There is at least one empty sector for GC."
 #endif
 
 #define SECTOR_HDR_DATA_SIZE                     (EF_WG_ALIGN(sizeof(struct sector_hdr_data)))
 #define SECTOR_DIRTY_OFFSET                      ((unsigned long)(&((struct sector_hdr_data *)0)->status_table.dirty))
+#define SECTOR_COMBINED_OFFSET                   ((unsigned long)(&((struct sector_hdr_data *)0)->combined))
 #define ENV_HDR_DATA_SIZE                        (EF_WG_ALIGN(sizeof(struct env_hdr_data)))
 #define ENV_MAGIC_OFFSET                         ((unsigned long)(&((struct env_hdr_data *)0)->magic))
+/* the next read of find_next_env_addr is overlapped with current read, so the magic word is NOT split by reads */
+#define ENV_FIND_STEP_SIZE                       (EF_READ_BUF_SIZE / 4 * 4 - EF_WG_ALIGN(sizeof(uint32_t)))
+#if !defined(EF_SCAN_USING_SCALAR) && (EF_READ_BUF_SIZE / 4 * 4 <= EF_WG_ALIGN(4))
+#error "EF_READ_BUF_SIZE must be greater than the magic word size which is aligned by EF_WRITE_GRAN"
+#endif
 #define ENV_LEN_OFFSET                           ((unsigned long)(&((struct env_hdr_data *)0)->len))
+#define ENV_CRC32_OFFSET                         ((unsigned long)(&((struct env_hdr_data *)0)->crc32))
 #define ENV_NAME_LEN_OFFSET                      ((unsigned long)(&((struct env_hdr_data *)0)->name_len))
+/* the ENV value is compressed, @see env_hdr_data.flag */
+#define ENV_FLAG_COMPRESSED                      0x01
+/* the counter ENV step table is behind the value, it's same as the status table */
+#define ENV_COUNTER_TABLE_SIZE                   (EF_WG_ALIGN(STATUS_TABLE_SIZE(EF_ENV_COUNTER_STEPS + 1)))
+/* the erase count table of the other combined sectors, it's on the end of combined sector */
+#define SECTOR_COMBINED_TABLE_SIZE(num)          (((num) - 1) * EF_WG_ALIGN(sizeof(uint32_t)))
+/* the max ENV size, the ENV which is larger than sector will be stored on combined sector */
+#define ENV_MAX_SIZE                             ((SECTOR_NUM - EF_GC_EMPTY_SEC_THRESHOLD) * SECTOR_SIZE - SECTOR_HDR_DATA_SIZE \
+                                                  - SECTOR_COMBINED_TABLE_SIZE(SECTOR_NUM - EF_GC_EMPTY_SEC_THRESHOLD))
 
 #define VER_NUM_ENV_NAME                         "__ver_num__"
+/* the batch commit ENV, its value is all batch ENV address */
+#define BATCH_ENV_NAME                           "__batch__"
 
 enum sector_store_status {
     SECTOR_STORE_UNUSED,
@@ -156,7 +314,7 @@ struct sector_hdr_data {
     } status_table;
     uint32_t magic;                              /**< magic word(`E`, `F`, `4`, `0`) */
     uint32_t combined;                           /**< the combined next sector number, 0xFFFFFFFF: not combined */
-    uint32_t reserved;
+    uint32_t erase_count;                        /**< the sector erase count, 0xFFFFFFFF: not counted by old version */
 };
 typedef struct sector_hdr_data *sector_hdr_data_t;
 
@@ -169,6 +327,7 @@ struct sector_meta_data {
     uint32_t addr;                               /**< sector start address */
     uint32_t magic;                              /**< magic word(`E`, `F`, `4`, `0`) */
     uint32_t combined;                           /**< the combined next sector number, 0xFFFFFFFF: not combined */
+    uint32_t erase_count;                        /**< the sector erase count */
     size_t remain;                               /**< remain size */
     uint32_t empty_env;                          /**< the next empty ENV node start address */
 };
@@ -180,7 +339,8 @@ struct env_hdr_data {
     uint32_t len;                                /**< ENV node total length (header + name + value), must align by EF_WRITE_GRAN */
     uint32_t crc32;                              /**< ENV node crc32(name_len + data_len + name + value) */
     uint8_t name_len;                            /**< name length */
-    uint32_t value_len;                          /**< value length */
+    uint8_t flag;                                /**< ENV flag, it's set when the bit is 0, @see ENV_FLAG_COMPRESSED */
+    uint32_t value_len;                          /**< value length, it's the original length when value is compressed */
 };
 typedef struct env_hdr_data *env_hdr_data_t;
 
@@ -188,6 +348,12 @@ struct env_cache_node {
     uint16_t name_crc;                           /**< ENV name's CRC32 low 16bit value */
     uint16_t active;                             /**< ENV node access active degree */
     uint32_t addr;                               /**< ENV node address */
+    bool verified;                               /**< ENV node CRC32 has been checked, the following header is valid */
+    bool is_compressed;                          /**< ENV value is compressed on flash */
+    uint8_t name_len;                            /**< name length */
+    uint32_t len;                                /**< ENV node total length */
+    uint32_t value_len;                          /**< value length */
+    uint32_t crc32;                              /**< ENV node crc32 */
 };
 typedef struct env_cache_node *env_cache_node_t;
 
@@ -197,7 +363,59 @@ struct sector_cache_node {
 };
 typedef struct sector_cache_node *sector_cache_node_t;
 
+struct env_index_node {
+    uint32_t name_crc;                           /**< ENV name's CRC32 value */
+    uint32_t addr;                               /**< ENV node address, FAILED_ADDR: empty slot */
+};
+typedef struct env_index_node *env_index_node_t;
+
+struct sector_map_node {
+    uint32_t combined;                           /**< the combined next sector number, 0xFFFFFFFF: not combined */
+    uint32_t empty_env;                          /**< the next empty ENV node start address */
+    uint32_t remain;                             /**< remain size */
+    uint32_t live;                               /**< the live (ENV_WRITE and ENV_PRE_DELETE) ENV total bytes */
+    uint32_t write_seq;                          /**< the full sector sequence when the ENV was written last time */
+    uint32_t erase_count;                        /**< the sector erase count */
+    uint8_t store;                               /**< sector store status @see sector_store_status_t */
+    uint8_t dirty;                               /**< sector dirty status @see sector_dirty_status_t */
+    bool check_ok;                               /**< sector header check is OK */
+};
+typedef struct sector_map_node *sector_map_node_t;
+
+struct env_read_cache_page {
+    uint32_t addr;                               /**< page start address, FAILED_ADDR: empty page */
+    uint32_t last_use;                           /**< the last used tick for LRU replacement, 0: empty page */
+    uint32_t data[EF_ENV_READ_CACHE_PAGE_SIZE / 4]; /**< page data */
+};
+typedef struct env_read_cache_page *env_read_cache_page_t;
+
+struct env_hot_node {
+    uint32_t name_crc;                           /**< ENV name's CRC32 value */
+    uint16_t freq;                               /**< ENV update frequency, it will be halved when a sector is full */
+    uint16_t hint;                               /**< ENV update frequency hint @see EfEnvHint */
+};
+typedef struct env_hot_node *env_hot_node_t;
+
+struct env_writer_node {
+    uint32_t addr;                               /**< ENV node address, FAILED_ADDR: no ENV is writing */
+    struct env_hdr_data hdr;                     /**< ENV header data, the CRC32 is calculating */
+    size_t written_len;                          /**< the value length which has been written to flash */
+    size_t window_len;                           /**< the value length on window */
+    uint8_t window[EF_WG_ALIGN(1)];              /**< the value which is NOT aligned by write granularity */
+    char name[EF_ENV_NAME_MAX + 1];              /**< ENV name */
+};
+typedef struct env_writer_node *env_writer_node_t;
+
+enum env_stream {
+    ENV_STREAM_COLD,
+    ENV_STREAM_HOT,
+    ENV_STREAM_NUM,
+};
+
 static void gc_collect(void);
+static void gc_collect_by_empty_sec(size_t threshold);
+static EfErrCode read_sector_meta_data(uint32_t addr, sector_meta_data_t sector, bool traversal);
+static EfErrCode read_env(env_node_obj_t env);
 
 /* ENV start address in flash */
 static uint32_t env_start_addr = 0;
@@ -211,6 +429,14 @@ static bool init_ok = false;
 static bool gc_request = false;
 /* is in recovery check status when first reboot */
 static bool in_recovery_check = false;
+/* the collecting sector address of incremental GC step, FAILED_ADDR: no sector is collecting */
+static uint32_t gc_step_addr = FAILED_ADDR;
+/* the last checked ENV on the collecting sector of incremental GC step */
+static struct env_node_obj gc_step_env;
+/* all live ENV on the collecting sector has been moved, it's only need to format */
+static bool gc_step_moved = false;
+/* the ENV which is writing by stream, @see ef_set_env_stream_open */
+static struct env_writer_node env_writer = { FAILED_ADDR };
 
 #ifdef EF_ENV_USING_CACHE
 /* ENV cache table */
@@ -219,6 +445,159 @@ struct env_cache_node env_cache_table[EF_ENV_CACHE_TABLE_SIZE] = { 0 };
 struct sector_cache_node sector_cache_table[EF_SECTOR_CACHE_TABLE_SIZE] = { 0 };
 #endif /* EF_ENV_USING_CACHE */
 
+#ifdef EF_ENV_USING_INDEX
+/* ENV index table, it has all ENV_WRITE status ENV address when env_index_ok is true */
+static struct env_index_node env_index_table[EF_ENV_INDEX_TABLE_SIZE];
+/* the used slots number of ENV index table */
+static size_t env_index_used = 0;
+/* the ENV index table has all ENV, so the ENV which is NOT in table is NOT on flash */
+static bool env_index_ok = false;
+#endif /* EF_ENV_USING_INDEX */
+
+#ifdef EF_ENV_USING_BLOOM
+/* ENV negative lookup bloom filter, the ENV is definitely NOT on flash when it's NOT in filter */
+static uint8_t env_bloom_table[ENV_BLOOM_BITS / 8];
+/* the bloom filter has all ENV */
+static bool env_bloom_ok = false;
+/* the bloom filter statistics */
+static struct env_bloom_stats env_bloom_stat = { 0 };
+#endif /* EF_ENV_USING_BLOOM */
+
+#ifdef EF_ENV_USING_HOT_COLD
+/* ENV hot table, the empty slot's freq is 0 and hint is EF_ENV_HINT_AUTO */
+static struct env_hot_node env_hot_table[EF_ENV_HOT_TABLE_SIZE];
+/* the open sector address of cold and hot ENV stream, FAILED_ADDR: no sector is opened */
+static uint32_t env_stream_sec[ENV_STREAM_NUM] = { FAILED_ADDR, FAILED_ADDR };
+/* the sector will NOT be allocated, it's the open sector of other stream */
+static uint32_t alloc_skip_sec = FAILED_ADDR;
+#endif /* EF_ENV_USING_HOT_COLD */
+
+#ifdef EF_ENV_USING_XIP
+/* the pinned ENV value address, the sector which has pinned ENV will NOT be collected. 0: empty slot */
+static uint32_t env_pin_table[EF_ENV_PIN_TABLE_SIZE] = { 0 };
+#endif /* EF_ENV_USING_XIP */
+
+#ifdef EF_ENV_USING_READ_CACHE
+/* read cache pages, the page is invalidated when the flash is written or erased by ENV */
+static struct env_read_cache_page read_cache_table[EF_ENV_READ_CACHE_PAGE_NUM];
+/* the read cache tick, it will increase when a page is used */
+static uint32_t read_cache_tick = 0;
+/* the read cache statistics */
+static struct env_read_cache_stats read_cache_stat = { 0 };
+#endif /* EF_ENV_USING_READ_CACHE */
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+/* sector allocation map, it has all sector meta data when sector_map_ok is true */
+static struct sector_map_node sector_map_table[SECTOR_NUM];
+/* the sector map is same as the flash, the sector meta data will NOT read from flash */
+static bool sector_map_ok = false;
+/* the full sector sequence, it will increase when a sector is full */
+static uint32_t sector_map_full_seq = 0;
+#endif /* EF_ENV_USING_SECTOR_MAP */
+
+#ifdef EF_ENV_USING_READ_CACHE
+/*
+ * Get the read cache page, the least recently used page will be replaced by flash data when it's missed.
+ */
+static env_read_cache_page_t get_read_cache_page(uint32_t page_addr)
+{
+    size_t i, lru = 0;
+
+    for (i = 0; i < EF_ENV_READ_CACHE_PAGE_NUM; i++) {
+        if (read_cache_table[i].addr == page_addr) {
+            read_cache_stat.hit++;
+            read_cache_table[i].last_use = ++read_cache_tick;
+            return &read_cache_table[i];
+        }
+        if (read_cache_table[i].last_use < read_cache_table[lru].last_use) {
+            lru = i;
+        }
+    }
+    /* load the page from flash */
+    read_cache_stat.miss++;
+    if (ef_port_read(page_addr, read_cache_table[lru].data, EF_ENV_READ_CACHE_PAGE_SIZE) != EF_NO_ERR) {
+        read_cache_table[lru].addr = FAILED_ADDR;
+        read_cache_table[lru].last_use = 0;
+        return NULL;
+    }
+    read_cache_table[lru].addr = page_addr;
+    read_cache_table[lru].last_use = ++read_cache_tick;
+
+    return &read_cache_table[lru];
+}
+
+/*
+ * Invalidate the read cache pages which are overlapped with the flash area.
+ */
+static void invalidate_read_cache(uint32_t addr, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < EF_ENV_READ_CACHE_PAGE_NUM; i++) {
+        if (read_cache_table[i].addr != FAILED_ADDR && read_cache_table[i].addr < addr + size
+                && read_cache_table[i].addr + EF_ENV_READ_CACHE_PAGE_SIZE > addr) {
+            read_cache_table[i].addr = FAILED_ADDR;
+            read_cache_table[i].last_use = 0;
+        }
+    }
+}
+#endif /* EF_ENV_USING_READ_CACHE */
+
+/*
+ * Read the ENV area flash. The small read will be served by read cache pages when EF_ENV_USING_READ_CACHE is enabled.
+ */
+static EfErrCode flash_read(uint32_t addr, uint32_t *buf, size_t size)
+{
+#ifdef EF_ENV_USING_READ_CACHE
+    env_read_cache_page_t page;
+    uint32_t page_addr, cur_addr = addr;
+    size_t read_size, remain = size;
+    uint8_t *data = (uint8_t *) buf;
+
+    /* the large read will NOT be cached, so the cached pages will NOT be replaced by it */
+    if (size < EF_ENV_READ_CACHE_PAGE_SIZE && addr >= env_start_addr && addr + size <= env_start_addr + ENV_AREA_SIZE) {
+        for (; remain > 0; cur_addr += read_size, data += read_size, remain -= read_size) {
+            page_addr = EF_ALIGN_DOWN(cur_addr, EF_ENV_READ_CACHE_PAGE_SIZE);
+            read_size = page_addr + EF_ENV_READ_CACHE_PAGE_SIZE - cur_addr;
+            if (read_size > remain) {
+                read_size = remain;
+            }
+            if ((page = get_read_cache_page(page_addr)) == NULL) {
+                return ef_port_read(addr, buf, size);
+            }
+            memcpy(data, (uint8_t *) page->data + (cur_addr - page_addr), read_size);
+        }
+        return EF_NO_ERR;
+    }
+#endif /* EF_ENV_USING_READ_CACHE */
+
+    return ef_port_read(addr, buf, size);
+}
+
+/*
+ * Write the ENV area flash, the read cache of written area will be invalidated.
+ */
+static EfErrCode flash_write(uint32_t addr, const uint32_t *buf, size_t size)
+{
+#ifdef EF_ENV_USING_READ_CACHE
+    invalidate_read_cache(addr, size);
+#endif
+
+    return ef_port_write(addr, buf, size);
+}
+
+/*
+ * Erase the ENV area flash, the read cache of erased area will be invalidated.
+ */
+static EfErrCode flash_erase(uint32_t addr, size_t size)
+{
+#ifdef EF_ENV_USING_READ_CACHE
+    invalidate_read_cache(addr, size);
+#endif
+
+    return ef_port_erase(addr, size);
+}
+
 static size_t set_status(uint8_t status_table[], size_t status_num, size_t status_index)
 {
     size_t byte_index = ~0UL;
@@ -280,11 +659,11 @@ static EfErrCode write_status(uint32_t addr, uint8_t status_table[], size_t stat
         return EF_NO_ERR;
     }
 #if (EF_WRITE_GRAN == 1)
-    result = ef_port_write(addr + byte_index, (uint32_t *)&status_table[byte_index], 1);
+    result = flash_write(addr + byte_index, (uint32_t *)&status_table[byte_index], 1);
 #else /*  (EF_WRITE_GRAN == 8) ||  (EF_WRITE_GRAN == 32) ||  (EF_WRITE_GRAN == 64) */
     /* write the status by write granularity
      * some flash (like stm32 onchip) NOT supported repeated write before erase */
-    result = ef_port_write(addr + byte_index, (uint32_t *) &status_table[byte_index], EF_WRITE_GRAN / 8);
+    result = flash_write(addr + byte_index, (uint32_t *) &status_table[byte_index], EF_WRITE_GRAN / 8);
 #endif /* EF_WRITE_GRAN == 1 */
 
     return result;
@@ -294,7 +673,7 @@ static size_t read_status(uint32_t addr, uint8_t status_table[], size_t total_nu
 {
     EF_ASSERT(status_table);
 
-    ef_port_read(addr, (uint32_t *) status_table, STATUS_TABLE_SIZE(total_num));
+    flash_read(addr, (uint32_t *) status_table, STATUS_TABLE_SIZE(total_num));
 
     return get_status(status_table, total_num);
 }
@@ -358,7 +737,10 @@ static void update_env_cache(const char *name, size_t name_len, uint32_t addr)
         if (addr != FAILED_ADDR) {
             /* update the ENV address in cache */
             if (env_cache_table[i].name_crc == name_crc) {
-                env_cache_table[i].addr = addr;
+                if (env_cache_table[i].addr != addr) {
+                    env_cache_table[i].addr = addr;
+                    env_cache_table[i].verified = false;
+                }
                 return;
             } else if ((env_cache_table[i].addr == FAILED_ADDR) && (empty_index == EF_ENV_CACHE_TABLE_SIZE)) {
                 empty_index = i;
@@ -383,17 +765,36 @@ static void update_env_cache(const char *name, size_t name_len, uint32_t addr)
         env_cache_table[empty_index].addr = addr;
         env_cache_table[empty_index].name_crc = name_crc;
         env_cache_table[empty_index].active = 0;
+        env_cache_table[empty_index].verified = false;
     } else if (min_activity_index < EF_ENV_CACHE_TABLE_SIZE) {
         env_cache_table[min_activity_index].addr = addr;
         env_cache_table[min_activity_index].name_crc = name_crc;
         env_cache_table[min_activity_index].active = 0;
+        env_cache_table[min_activity_index].verified = false;
+    }
+}
+
+/*
+ * The cached ENV on [addr, addr + size) will be verified by CRC32 again when it's hit next time.
+ */
+static void unverify_env_cache(uint32_t addr, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < EF_ENV_CACHE_TABLE_SIZE; i++) {
+        if (env_cache_table[i].addr >= addr && env_cache_table[i].addr - addr < size) {
+            env_cache_table[i].verified = false;
+        }
     }
 }
 
 /*
  * Get ENV info from cache. It's return true when cache is hit.
+ *
+ * The verified ENV is filled by the cached header, so it only reads the name for comparing.
+ * The others will be read and CRC32 checked once, then the header will be cached.
  */
-static bool get_env_from_cache(const char *name, size_t name_len, uint32_t *addr)
+static bool get_env_from_cache(const char *name, size_t name_len, env_node_obj_t env)
 {
     size_t i;
     uint16_t name_crc = (uint16_t) (ef_calc_crc32(0, name, name_len) >> 16);
@@ -402,9 +803,28 @@ static bool get_env_from_cache(const char *name, size_t name_len, uint32_t *addr
         if ((env_cache_table[i].addr != FAILED_ADDR) && (env_cache_table[i].name_crc == name_crc)) {
             char saved_name[EF_ENV_NAME_MAX];
             /* read the ENV name in flash */
-            ef_port_read(env_cache_table[i].addr + ENV_HDR_DATA_SIZE, (uint32_t *) saved_name, EF_ENV_NAME_MAX);
+            flash_read(env_cache_table[i].addr + ENV_HDR_DATA_SIZE, (uint32_t *) saved_name, EF_ENV_NAME_MAX);
             if (!strncmp(name, saved_name, name_len)) {
-                *addr = env_cache_table[i].addr;
+                env->addr.start = env_cache_table[i].addr;
+                if (env_cache_table[i].verified) {
+                    env->status = ENV_WRITE;
+                    env->crc_is_ok = true;
+                    env->crc_is_deferred = false;
+                    env->is_compressed = env_cache_table[i].is_compressed;
+                    env->name_len = env_cache_table[i].name_len;
+                    env->len = env_cache_table[i].len;
+                    env->value_len = env_cache_table[i].value_len;
+                    env->crc32 = env_cache_table[i].crc32;
+                    memcpy(env->name, saved_name, EF_ENV_NAME_MAX);
+                    env->addr.value = env->addr.start + ENV_HDR_DATA_SIZE + EF_WG_ALIGN(env->name_len);
+                } else if (read_env(env) == EF_NO_ERR && env->status == ENV_WRITE) {
+                    env_cache_table[i].verified = true;
+                    env_cache_table[i].is_compressed = env->is_compressed;
+                    env_cache_table[i].name_len = env->name_len;
+                    env_cache_table[i].len = env->len;
+                    env_cache_table[i].value_len = env->value_len;
+                    env_cache_table[i].crc32 = env->crc32;
+                }
                 if (env_cache_table[i].active >= 0xFFFF - EF_ENV_CACHE_TABLE_SIZE) {
                     env_cache_table[i].active = 0xFFFF;
                 } else {
@@ -419,988 +839,3896 @@ static bool get_env_from_cache(const char *name, size_t name_len, uint32_t *addr
 }
 #endif /* EF_ENV_USING_CACHE */
 
+#ifdef EF_ENV_USING_INDEX
 /*
- * find the continue 0xFF flash address to end address
+ * Check the ENV name on flash is same as the input name.
  */
-static uint32_t continue_ff_addr(uint32_t start, uint32_t end)
+static bool env_name_is_equal(uint32_t addr, const char *name, size_t name_len)
 {
-    uint8_t buf[EF_READ_BUF_SIZE], last_data = 0x00;
-    size_t i, addr = start, read_size;
+    struct env_hdr_data env_hdr;
+    char saved_name[EF_ENV_NAME_MAX];
 
-    for (; start < end; start += sizeof(buf)) {
-        if (start + sizeof(buf) < end) {
-            read_size = sizeof(buf);
-        } else {
-            read_size = end - start;
-        }
-        ef_port_read(start, (uint32_t *) buf, read_size);
-        for (i = 0; i < read_size; i++) {
-            if (last_data != 0xFF && buf[i] == 0xFF) {
-                addr = start + i;
-            }
-            last_data = buf[i];
-        }
+    flash_read(addr, (uint32_t *) &env_hdr, sizeof(struct env_hdr_data));
+    if (env_hdr.name_len != name_len || name_len > EF_ENV_NAME_MAX) {
+        return false;
     }
+    flash_read(addr + ENV_HDR_DATA_SIZE, (uint32_t *) saved_name, EF_WG_ALIGN(name_len));
 
-    if (last_data == 0xFF) {
-        return EF_WG_ALIGN(addr);
-    } else {
-        return end;
+    return !strncmp(name, saved_name, name_len);
+}
+
+static void env_index_reset(void)
+{
+    size_t i;
+
+    for (i = 0; i < EF_ENV_INDEX_TABLE_SIZE; i++) {
+        env_index_table[i].addr = FAILED_ADDR;
     }
+    env_index_used = 0;
+    env_index_ok = true;
 }
 
 /*
- * find the next ENV address by magic word on the flash
+ * Find the ENV slot in index table by linear probing.
+ * It's return the empty slot which will be used by this ENV when not found.
  */
-static uint32_t find_next_env_addr(uint32_t start, uint32_t end)
+static size_t env_index_lookup(const char *name, size_t name_len, uint32_t name_crc, bool *find_ok)
 {
-    uint8_t buf[32];
-    uint32_t start_bak = start, i;
-    uint32_t magic;
-
-#ifdef EF_ENV_USING_CACHE
-    uint32_t empty_env;
+    size_t i = name_crc % EF_ENV_INDEX_TABLE_SIZE;
 
-    if (get_sector_from_cache(EF_ALIGN_DOWN(start, SECTOR_SIZE), &empty_env) && start == empty_env) {
-        return FAILED_ADDR;
+    *find_ok = false;
+    /* there is at least one empty slot in table, so the probing will be stopped */
+    while (env_index_table[i].addr != FAILED_ADDR) {
+        if (env_index_table[i].name_crc == name_crc && env_name_is_equal(env_index_table[i].addr, name, name_len)) {
+            *find_ok = true;
+            break;
+        }
+        i = (i + 1) % EF_ENV_INDEX_TABLE_SIZE;
     }
-#endif /* EF_ENV_USING_CACHE */
 
-    for (; start < end; start += (sizeof(buf) - sizeof(uint32_t))) {
-        ef_port_read(start, (uint32_t *) buf, sizeof(buf));
-        for (i = 0; i < sizeof(buf) - sizeof(uint32_t) && start + i < end; i++) {
-#ifndef EF_BIG_ENDIAN            /* Little Endian Order */
-            magic = buf[i] + (buf[i + 1] << 8) + (buf[i + 2] << 16) + (buf[i + 3] << 24);
-#else                       /* Big Endian Order */
-            magic = buf[i + 3] + (buf[i + 2] << 8) + (buf[i + 1] << 16) + (buf[i] << 24);
-#endif
-            if (magic == ENV_MAGIC_WORD && (start + i - ENV_MAGIC_OFFSET) >= start_bak) {
-                return start + i - ENV_MAGIC_OFFSET;
-            }
-        }
+    return i;
+}
+
+/*
+ * Get ENV address from index table. It's return true when the ENV is found.
+ */
+static bool get_env_from_index(const char *name, size_t name_len, uint32_t *addr)
+{
+    bool find_ok;
+    size_t i = env_index_lookup(name, name_len, ef_calc_crc32(0, name, name_len), &find_ok);
+
+    if (find_ok) {
+        *addr = env_index_table[i].addr;
     }
 
-    return FAILED_ADDR;
+    return find_ok;
 }
 
-static uint32_t get_next_env_addr(sector_meta_data_t sector, env_node_obj_t pre_env)
+/*
+ * Add or update the ENV address in index table.
+ */
+static void update_env_index(const char *name, size_t name_len, uint32_t addr)
 {
-    uint32_t addr = FAILED_ADDR;
+    uint32_t name_crc = ef_calc_crc32(0, name, name_len);
+    bool find_ok;
+    size_t i = env_index_lookup(name, name_len, name_crc, &find_ok);
 
-    if (sector->status.store == SECTOR_STORE_EMPTY) {
-        return FAILED_ADDR;
+    if (find_ok) {
+        env_index_table[i].addr = addr;
+    } else if (env_index_used < EF_ENV_INDEX_TABLE_SIZE - 1) {
+        env_index_table[i].name_crc = name_crc;
+        env_index_table[i].addr = addr;
+        env_index_used++;
+    } else if (env_index_ok) {
+        /* the index table is NOT has all ENV now, the ENV find will fall back to traversal */
+        EF_INFO("Warning: The ENV index table is full. Please increase the EF_ENV_INDEX_TABLE_SIZE.\n");
+        env_index_ok = false;
     }
+}
 
-    if (pre_env->addr.start == FAILED_ADDR) {
-        /* the first ENV address */
-        addr = sector->addr + SECTOR_HDR_DATA_SIZE;
-    } else {
-        if (pre_env->addr.start <= sector->addr + SECTOR_SIZE) {
-            if (pre_env->crc_is_ok) {
-                addr = pre_env->addr.start + pre_env->len;
-            } else {
-                /* when pre_env CRC check failed, maybe the flash has error data
-                 * find_next_env_addr after pre_env address */
-                addr = pre_env->addr.start + EF_WG_ALIGN(1);
-            }
-            /* check and find next ENV address */
-            addr = find_next_env_addr(addr, sector->addr + SECTOR_SIZE - SECTOR_HDR_DATA_SIZE);
+/*
+ * Delete the slot, then shift the following slots back to keep all probing sequence continuous.
+ */
+static void env_index_delete_slot(size_t i)
+{
+    size_t j = i, home;
 
-            if (addr > sector->addr + SECTOR_SIZE || pre_env->len == 0) {
-                //TODO ģʽ
-                return FAILED_ADDR;
-            }
-        } else {
-            /* no ENV */
-            return FAILED_ADDR;
+    env_index_table[i].addr = FAILED_ADDR;
+    env_index_used--;
+
+    while (true) {
+        j = (j + 1) % EF_ENV_INDEX_TABLE_SIZE;
+        if (env_index_table[j].addr == FAILED_ADDR) {
+            break;
+        }
+        home = env_index_table[j].name_crc % EF_ENV_INDEX_TABLE_SIZE;
+        /* the slot can be moved to the deleted slot when its home is NOT in (i, j] */
+        if ((i <= j) ? (home <= i || home > j) : (home <= i && home > j)) {
+            env_index_table[i] = env_index_table[j];
+            env_index_table[j].addr = FAILED_ADDR;
+            i = j;
         }
     }
-
-    return addr;
 }
 
-static EfErrCode read_env(env_node_obj_t env)
+/*
+ * Delete the ENV from index table. Only delete it when the saved address is same as the deleted ENV address.
+ */
+static void delete_env_index(const char *name, size_t name_len, uint32_t addr)
 {
-    struct env_hdr_data env_hdr;
-    uint8_t buf[EF_READ_BUF_SIZE];
-    uint32_t calc_crc32 = 0, crc_data_len, env_name_addr;
-    EfErrCode result = EF_NO_ERR;
-    size_t len, size;
-    /* read ENV header raw data */
-    ef_port_read(env->addr.start, (uint32_t *)&env_hdr, sizeof(struct env_hdr_data));
-    env->status = (env_status_t) get_status(env_hdr.status_table, ENV_STATUS_NUM);
-    env->len = env_hdr.len;
+    uint32_t name_crc = ef_calc_crc32(0, name, name_len);
+    size_t i = name_crc % EF_ENV_INDEX_TABLE_SIZE;
 
-    if (env->len == ~0UL || env->len > ENV_AREA_SIZE || env->len < ENV_NAME_LEN_OFFSET) {
-        /* the ENV length was not write, so reserved the meta data for current ENV */
-        env->len = ENV_HDR_DATA_SIZE;
-        if (env->status != ENV_ERR_HDR) {
-            env->status = ENV_ERR_HDR;
-            EF_DEBUG("Error: The ENV @0x%08X length has an error.\n", env->addr.start);
-            write_status(env->addr.start, env_hdr.status_table, ENV_STATUS_NUM, ENV_ERR_HDR);
+    while (env_index_table[i].addr != FAILED_ADDR) {
+        if (env_index_table[i].addr == addr) {
+            env_index_delete_slot(i);
+            return;
         }
-        env->crc_is_ok = false;
-        return EF_READ_ERR;
-    } else if (env->len > SECTOR_SIZE - SECTOR_HDR_DATA_SIZE && env->len < ENV_AREA_SIZE) {
-        //TODO ģʽд볤ûд
-        EF_ASSERT(0);
+        i = (i + 1) % EF_ENV_INDEX_TABLE_SIZE;
     }
+}
 
-    /* CRC32 data len(header.name_len + header.value_len + name + value) */
-    crc_data_len = env->len - ENV_NAME_LEN_OFFSET;
-    /* calculate the CRC32 value */
-    for (len = 0, size = 0; len < crc_data_len; len += size) {
-        if (len + sizeof(buf) < crc_data_len) {
-            size = sizeof(buf);
-        } else {
-            size = crc_data_len - len;
+/*
+ * Delete all ENV which is on the sector from index table.
+ */
+static void delete_sector_env_index(uint32_t sec_addr)
+{
+    size_t i;
+    bool deleted;
+
+    do {
+        /* the slots maybe shifted to the checked slot after delete, so check all slots again */
+        deleted = false;
+        for (i = 0; i < EF_ENV_INDEX_TABLE_SIZE; i++) {
+            while (env_index_table[i].addr != FAILED_ADDR && env_index_table[i].addr >= sec_addr
+                    && env_index_table[i].addr < sec_addr + SECTOR_SIZE) {
+                env_index_delete_slot(i);
+                deleted = true;
+            }
         }
+    } while (deleted);
+}
+#endif /* EF_ENV_USING_INDEX */
 
-        ef_port_read(env->addr.start + ENV_NAME_LEN_OFFSET + len, (uint32_t *) buf, EF_WG_ALIGN(size));
-        calc_crc32 = ef_calc_crc32(calc_crc32, buf, size);
+#ifdef EF_ENV_USING_HOT_COLD
+/*
+ * Find the ENV on hot table. The slot which has the least update frequency will be replaced when add is true.
+ */
+static env_hot_node_t env_hot_lookup(const char *name, size_t name_len, bool add)
+{
+    size_t i, min_freq_index = EF_ENV_HOT_TABLE_SIZE;
+    uint32_t name_crc = ef_calc_crc32(0, name, name_len);
+    env_hot_node_t node;
+
+    for (i = 0; i < EF_ENV_HOT_TABLE_SIZE; i++) {
+        node = &env_hot_table[i];
+        if ((node->freq > 0 || node->hint != EF_ENV_HINT_AUTO) && node->name_crc == name_crc) {
+            return node;
+        } else if (node->hint == EF_ENV_HINT_AUTO
+                && (min_freq_index == EF_ENV_HOT_TABLE_SIZE || node->freq < env_hot_table[min_freq_index].freq)) {
+            /* the hinted ENV will NOT be replaced */
+            min_freq_index = i;
+        }
     }
-    /* check CRC32 */
-    if (calc_crc32 != env_hdr.crc32) {
-        env->crc_is_ok = false;
-        result = EF_READ_ERR;
-    } else {
-        env->crc_is_ok = true;
-        /* the name is behind aligned ENV header */
-        env_name_addr = env->addr.start + ENV_HDR_DATA_SIZE;
-        ef_port_read(env_name_addr, (uint32_t *) env->name, EF_WG_ALIGN(env_hdr.name_len));
-        /* the value is behind aligned name */
-        env->addr.value = env_name_addr + EF_WG_ALIGN(env_hdr.name_len);
-        env->value_len = env_hdr.value_len;
-        env->name_len = env_hdr.name_len;
+    if (add && min_freq_index < EF_ENV_HOT_TABLE_SIZE) {
+        node = &env_hot_table[min_freq_index];
+        node->name_crc = name_crc;
+        node->freq = 0;
+        node->hint = EF_ENV_HINT_AUTO;
+        return node;
     }
 
-    return result;
+    return NULL;
 }
 
-static EfErrCode read_sector_meta_data(uint32_t addr, sector_meta_data_t sector, bool traversal)
+/*
+ * The ENV has been updated (the old ENV is found when set it).
+ */
+static void env_hot_update(const char *name, size_t name_len)
 {
-    EfErrCode result = EF_NO_ERR;
-    struct sector_hdr_data sec_hdr;
+    env_hot_node_t node = env_hot_lookup(name, name_len, true);
 
-    EF_ASSERT(addr % SECTOR_SIZE == 0);
-    EF_ASSERT(sector);
+    if (node != NULL && node->freq < 0xFFFF) {
+        node->freq++;
+    }
+}
 
-    /* read sector header raw data */
-    ef_port_read(addr, (uint32_t *)&sec_hdr, sizeof(struct sector_hdr_data));
+/*
+ * Age the update frequency of all ENV, it's called when a sector is full.
+ */
+static void env_hot_decay(void)
+{
+    size_t i;
 
-    sector->addr = addr;
-    sector->magic = sec_hdr.magic;
-    /* check magic word */
-    if (sector->magic != SECTOR_MAGIC_WORD) {
-        sector->check_ok = false;
-        sector->combined = SECTOR_NOT_COMBINED;
-        return EF_ENV_INIT_FAILED;
+    for (i = 0; i < EF_ENV_HOT_TABLE_SIZE; i++) {
+        env_hot_table[i].freq >>= 1;
     }
-    sector->check_ok = true;
-    /* get other sector meta data */
-    sector->combined = sec_hdr.combined;
-    sector->status.store = (sector_store_status_t) get_status(sec_hdr.status_table.store, SECTOR_STORE_STATUS_NUM);
-    sector->status.dirty = (sector_dirty_status_t) get_status(sec_hdr.status_table.dirty, SECTOR_DIRTY_STATUS_NUM);
-    /* traversal all ENV and calculate the remain space size */
-    if (traversal) {
-        sector->remain = 0;
-        sector->empty_env = sector->addr + SECTOR_HDR_DATA_SIZE;
-        if (sector->status.store == SECTOR_STORE_EMPTY) {
-            sector->remain = SECTOR_SIZE - SECTOR_HDR_DATA_SIZE;
-        } else if (sector->status.store == SECTOR_STORE_USING) {
-            struct env_node_obj env_meta;
+}
 
-#ifdef EF_ENV_USING_CACHE
-            if (get_sector_from_cache(addr, &sector->empty_env)) {
-                sector->remain = SECTOR_SIZE - (sector->empty_env - sector->addr);
-                return result;
-            }
-#endif /* EF_ENV_USING_CACHE */
+/*
+ * Check the ENV is hot, the hot ENV will be written to the hot stream open sector.
+ */
+static bool env_is_hot(const char *name, size_t name_len)
+{
+    env_hot_node_t node = env_hot_lookup(name, name_len, false);
 
-            sector->remain = SECTOR_SIZE - SECTOR_HDR_DATA_SIZE;
-            env_meta.addr.start = FAILED_ADDR;
-            while ((env_meta.addr.start = get_next_env_addr(sector, &env_meta)) != FAILED_ADDR) {
-                read_env(&env_meta);
-                if (!env_meta.crc_is_ok) {
-                    if (env_meta.status != ENV_PRE_WRITE && env_meta.status!= ENV_ERR_HDR) {
-                        EF_INFO("Error: The ENV (@0x%08X) CRC32 check failed!\n", env_meta.addr.start);
-                        sector->remain = 0;
-                        result = EF_READ_ERR;
-                        break;
-                    }
-                }
-                sector->empty_env += env_meta.len;
-                sector->remain -= env_meta.len;
-            }
-            /* check the empty ENV address by read continue 0xFF on flash  */
-            {
-                uint32_t ff_addr;
+    if (node == NULL) {
+        return false;
+    } else if (node->hint != EF_ENV_HINT_AUTO) {
+        return node->hint == EF_ENV_HINT_HOT;
+    } else {
+        return node->freq >= EF_ENV_HOT_THRESHOLD;
+    }
+}
+#endif /* EF_ENV_USING_HOT_COLD */
 
-                ff_addr = continue_ff_addr(sector->empty_env, sector->addr + SECTOR_SIZE);
-                /* check the flash data is clean */
-                if (sector->empty_env != ff_addr) {
-                    /* update the sector information */
-                    sector->empty_env = ff_addr;
-                    sector->remain = SECTOR_SIZE - (ff_addr - sector->addr);
-                }
-            }
+/*
+ * Check the sector has pinned ENV, the sector can NOT be collected by GC.
+ * The pinned ENV is the ENV which value is used in place or the ENV which is writing by stream.
+ */
+static bool sector_is_pinned(uint32_t sec_addr)
+{
+    if (env_writer.addr != FAILED_ADDR && EF_ALIGN_DOWN(env_writer.addr, SECTOR_SIZE) == sec_addr) {
+        return true;
+    }
 
-#ifdef EF_ENV_USING_CACHE
-            update_sector_cache(sector->addr, sector->empty_env);
-#endif
+#ifdef EF_ENV_USING_XIP
+    {
+        size_t i;
+
+        for (i = 0; i < EF_ENV_PIN_TABLE_SIZE; i++) {
+            if (env_pin_table[i] != 0 && EF_ALIGN_DOWN(env_pin_table[i], SECTOR_SIZE) == sec_addr) {
+                return true;
+            }
         }
     }
+#endif /* EF_ENV_USING_XIP */
 
-    return result;
+    return false;
 }
 
-static uint32_t get_next_sector_addr(sector_meta_data_t pre_sec)
+#ifdef EF_ENV_USING_SECTOR_MAP
+/*
+ * Get the sector map node which the address is on. It's return NULL when the map is NOT OK.
+ */
+static sector_map_node_t get_sector_map_node(uint32_t addr)
 {
-    uint32_t next_addr;
+    if (!sector_map_ok || addr < env_start_addr || addr >= env_start_addr + ENV_AREA_SIZE) {
+        return NULL;
+    }
 
-    if (pre_sec->addr == FAILED_ADDR) {
-        return env_start_addr;
-    } else {
-        /* check ENV sector combined */
-        if (pre_sec->combined == SECTOR_NOT_COMBINED) {
-            next_addr = pre_sec->addr + SECTOR_SIZE;
-        } else {
-            next_addr = pre_sec->addr + pre_sec->combined * SECTOR_SIZE;
-        }
-        /* check range */
-        if (next_addr < env_start_addr + ENV_AREA_SIZE) {
-            return next_addr;
-        } else {
-            /* no sector */
-            return FAILED_ADDR;
-        }
+    return &sector_map_table[(addr - env_start_addr) / SECTOR_SIZE];
+}
+
+static bool get_sector_from_map(uint32_t addr, sector_meta_data_t sector)
+{
+    sector_map_node_t node = get_sector_map_node(addr);
+
+    if (node == NULL) {
+        return false;
     }
+
+    sector->addr = addr;
+    sector->check_ok = node->check_ok;
+    sector->magic = node->check_ok ? SECTOR_MAGIC_WORD : 0xFFFFFFFF;
+    sector->combined = node->combined;
+    sector->erase_count = node->erase_count;
+    sector->status.store = (sector_store_status_t) node->store;
+    sector->status.dirty = (sector_dirty_status_t) node->dirty;
+    sector->empty_env = node->empty_env;
+    sector->remain = node->remain;
+
+    return true;
 }
 
-static void env_iterator(env_node_obj_t env, void *arg1, void *arg2,
-        bool (*callback)(env_node_obj_t env, void *arg1, void *arg2))
+/*
+ * Update the sector status on map, the SECTOR_STORE_UNUSED and SECTOR_DIRTY_UNUSED will keep the old status.
+ */
+static void update_sector_map_status(uint32_t sec_addr, sector_store_status_t store, sector_dirty_status_t dirty)
 {
-    struct sector_meta_data sector;
-    uint32_t sec_addr;
+    sector_map_node_t node = get_sector_map_node(sec_addr);
 
-    sector.addr = FAILED_ADDR;
-    /* search all sectors */
-    while ((sec_addr = get_next_sector_addr(&sector)) != FAILED_ADDR) {
-        if (read_sector_meta_data(sec_addr, &sector, false) != EF_NO_ERR) {
-            continue;
-        }
-        if (callback == NULL) {
-            continue;
-        }
-        /* sector has ENV */
-        if (sector.status.store == SECTOR_STORE_USING || sector.status.store == SECTOR_STORE_FULL) {
-            env->addr.start = FAILED_ADDR;
-            /* search all ENV */
-            while ((env->addr.start = get_next_env_addr(&sector, env)) != FAILED_ADDR) {
-                read_env(env);
-                /* iterator is interrupted when callback return true */
-                if (callback(env, arg1, arg2)) {
-                    return;
-                }
+    if (node != NULL) {
+        if (store != SECTOR_STORE_UNUSED) {
+            node->store = store;
+            if (store == SECTOR_STORE_FULL) {
+                sector_map_full_seq++;
             }
         }
+        if (dirty != SECTOR_DIRTY_UNUSED) {
+            node->dirty = dirty;
+        }
     }
 }
 
-static bool find_env_cb(env_node_obj_t env, void *arg1, void *arg2)
+/*
+ * The sector has been formatted.
+ */
+static void reset_sector_map(uint32_t sec_addr, uint32_t combined, uint32_t erase_count, bool check_ok)
 {
-    const char *key = arg1;
-    bool *find_ok = arg2;
-    size_t key_len = strlen(key);
+    sector_map_node_t node = get_sector_map_node(sec_addr);
+
+    if (node != NULL) {
+        node->check_ok = check_ok;
+        node->combined = combined;
+        node->erase_count = erase_count;
+        node->store = SECTOR_STORE_EMPTY;
+        node->dirty = SECTOR_DIRTY_FALSE;
+        node->empty_env = sec_addr + SECTOR_HDR_DATA_SIZE;
+        node->remain = SECTOR_SIZE - SECTOR_HDR_DATA_SIZE;
+        node->live = 0;
+        node->write_seq = sector_map_full_seq;
+    }
+}
 
-    if (key_len != env->name_len) {
-        return false;
+/*
+ * A new live ENV has been written to the empty ENV address of sector.
+ */
+static void alloc_sector_map_env(uint32_t env_addr, size_t env_len)
+{
+    sector_map_node_t node = get_sector_map_node(env_addr);
+
+    if (node != NULL) {
+        node->empty_env = env_addr + env_len;
+        /* the combined sector has more than one sector size */
+        node->remain = EF_ALIGN_DOWN(env_addr, SECTOR_SIZE)
+                + SECTOR_SIZE * (node->combined == SECTOR_NOT_COMBINED ? 1 : node->combined) - node->empty_env;
+        node->live += env_len;
+        node->write_seq = sector_map_full_seq;
     }
-    /* check ENV */
-    if (env->crc_is_ok && env->status == ENV_WRITE && !strncmp(env->name, key, key_len)) {
-        *find_ok = true;
-        return true;
+}
+
+/*
+ * A live ENV has been deleted, it's a dead ENV now.
+ */
+static void free_sector_map_env(uint32_t env_addr, size_t env_len)
+{
+    sector_map_node_t node = get_sector_map_node(env_addr);
+
+    if (node != NULL) {
+        node->live = node->live > env_len ? node->live - env_len : 0;
     }
-    return false;
 }
+#endif /* EF_ENV_USING_SECTOR_MAP */
 
-static bool find_env_no_cache(const char *key, env_node_obj_t env)
+/*
+ * find the continue 0xFF flash address to end address
+ */
+static uint32_t continue_ff_addr(uint32_t start, uint32_t end)
 {
-    bool find_ok = false;
+#ifdef EF_SCAN_USING_SCALAR
+    uint8_t buf[EF_READ_BUF_SIZE], last_data = 0x00;
+    size_t i, addr = start, read_size;
+
+    /* the scalar version checks the data byte by byte from start address */
+    for (; start < end; start += sizeof(buf)) {
+        if (start + sizeof(buf) < end) {
+            read_size = sizeof(buf);
+        } else {
+            read_size = end - start;
+        }
+        flash_read(start, (uint32_t *) buf, read_size);
+        for (i = 0; i < read_size; i++) {
+            if (last_data != 0xFF && buf[i] == 0xFF) {
+                addr = start + i;
+            }
+            last_data = buf[i];
+        }
+    }
 
-    env_iterator(env, (void *)key, &find_ok, find_env_cb);
+    if (last_data == 0xFF) {
+        return EF_WG_ALIGN(addr);
+    } else {
+        return end;
+    }
+#else
+    uint32_t buf[EF_READ_BUF_SIZE / 4], read_start;
+    size_t i;
 
-    return find_ok;
+    /* search the last not 0xFF data from end address, so only the 0xFF data will be read */
+    for (; end > start; end = read_start) {
+        if (end - start > sizeof(buf)) {
+            read_start = end - sizeof(buf);
+        } else {
+            read_start = start;
+        }
+        flash_read(read_start, buf, end - read_start);
+        for (i = end - read_start; i > 0; i--) {
+            /* check the 0xFF data word by word */
+            if (i % 4 == 0 && buf[i / 4 - 1] == 0xFFFFFFFF) {
+                i -= 3;
+            } else if (((uint8_t *) buf)[i - 1] != 0xFF) {
+                return EF_WG_ALIGN(read_start + i);
+            }
+        }
+    }
+
+    return EF_WG_ALIGN(start);
+#endif /* EF_SCAN_USING_SCALAR */
 }
 
-static bool find_env(const char *key, env_node_obj_t env)
+/*
+ * find the next ENV address by magic word on the flash
+ */
+static uint32_t find_next_env_addr(uint32_t start, uint32_t end)
 {
-    bool find_ok = false;
+#ifdef EF_SCAN_USING_SCALAR
+    uint8_t buf[32];
+    uint32_t start_bak = start, i, read_len;
+    uint32_t magic;
+#else
+    uint32_t buf[EF_READ_BUF_SIZE / 4];
+    uint32_t i, read_len, magic;
+#endif /* EF_SCAN_USING_SCALAR */
 
 #ifdef EF_ENV_USING_CACHE
-    size_t key_len = strlen(key);
+    uint32_t empty_env;
 
-    if (get_env_from_cache(key, key_len, &env->addr.start)) {
-        read_env(env);
-        return true;
+    if (get_sector_from_cache(EF_ALIGN_DOWN(start, SECTOR_SIZE), &empty_env) && start == empty_env) {
+        return FAILED_ADDR;
     }
 #endif /* EF_ENV_USING_CACHE */
 
-    find_ok = find_env_no_cache(key, env);
+#ifdef EF_SCAN_USING_SCALAR
+    /* the whole ENV header must be in the find area, so the last magic word ends at here */
+    end -= ENV_HDR_DATA_SIZE - ENV_MAGIC_OFFSET - sizeof(uint32_t);
 
-#ifdef EF_ENV_USING_CACHE
-    if (find_ok) {
-        update_env_cache(key, key_len, env->addr.start);
+    /* the scalar version checks the magic word on every byte offset */
+    for (; start + sizeof(uint32_t) <= end; start += (sizeof(buf) - sizeof(uint32_t))) {
+        read_len = end - start < sizeof(buf) ? end - start : sizeof(buf);
+        flash_read(start, (uint32_t *) buf, read_len);
+        for (i = 0; i < sizeof(buf) - sizeof(uint32_t) && i + sizeof(uint32_t) <= read_len; i++) {
+#ifndef EF_BIG_ENDIAN            /* Little Endian Order */
+            magic = buf[i] + (buf[i + 1] << 8) + (buf[i + 2] << 16) + (buf[i + 3] << 24);
+#else                       /* Big Endian Order */
+            magic = buf[i + 3] + (buf[i + 2] << 8) + (buf[i + 1] << 16) + (buf[i] << 24);
+#endif
+            if (magic == ENV_MAGIC_WORD && (start + i - ENV_MAGIC_OFFSET) >= start_bak) {
+                return start + i - ENV_MAGIC_OFFSET;
+            }
+        }
     }
-#endif /* EF_ENV_USING_CACHE */
+#else
+    /* the ENV address is aligned by write granularity, so only the aligned magic word will be checked */
+    start += ENV_MAGIC_OFFSET;
+    /* the whole ENV header must be in the find area, so the last magic word ends at here */
+    end -= ENV_HDR_DATA_SIZE - ENV_MAGIC_OFFSET - sizeof(uint32_t);
+
+    for (; start + sizeof(uint32_t) <= end; start += ENV_FIND_STEP_SIZE) {
+        read_len = end - start < sizeof(buf) ? end - start : sizeof(buf);
+        flash_read(start, buf, read_len);
+        for (i = 0; i < ENV_FIND_STEP_SIZE && i + sizeof(uint32_t) <= read_len; i += EF_WG_ALIGN(1)) {
+            /* the magic word is in the native byte order, so it's compared by word */
+#if (EF_WRITE_GRAN >= 32)
+            magic = buf[i / 4];
+#else
+            memcpy(&magic, (uint8_t *) buf + i, sizeof(uint32_t));
+#endif
+            if (magic == ENV_MAGIC_WORD) {
+                return start + i - ENV_MAGIC_OFFSET;
+            }
+        }
+    }
+#endif /* EF_SCAN_USING_SCALAR */
 
-    return find_ok;
+    return FAILED_ADDR;
 }
 
-static bool ef_is_str(uint8_t *value, size_t len)
+/*
+ * Get the sector size, the combined sector size is the total size of all combined sectors.
+ */
+static uint32_t get_sector_size(sector_meta_data_t sector)
 {
-#define __is_print(ch)       ((unsigned int)((ch) - ' ') < 127u - ' ')
-    size_t i;
+    if (sector->combined == SECTOR_NOT_COMBINED) {
+        return SECTOR_SIZE;
+    } else {
+        return sector->combined * SECTOR_SIZE;
+    }
+}
+
+static uint32_t get_next_env_addr(sector_meta_data_t sector, env_node_obj_t pre_env)
+{
+    uint32_t addr = FAILED_ADDR;
+
+    if (sector->status.store == SECTOR_STORE_EMPTY) {
+        return FAILED_ADDR;
+    }
+
+    if (pre_env->addr.start == FAILED_ADDR) {
+        /* the first ENV address */
+        addr = sector->addr + SECTOR_HDR_DATA_SIZE;
+    } else if (sector->combined != SECTOR_NOT_COMBINED) {
+        /* the combined sector only has one ENV */
+        return FAILED_ADDR;
+    } else {
+        if (pre_env->addr.start <= sector->addr + SECTOR_SIZE) {
+            if (pre_env->crc_is_ok || pre_env->crc_is_deferred) {
+                addr = pre_env->addr.start + pre_env->len;
+            } else {
+                /* when pre_env CRC check failed, maybe the flash has error data
+                 * find_next_env_addr after pre_env address */
+                addr = pre_env->addr.start + EF_WG_ALIGN(1);
+            }
+            /* check and find next ENV address */
+            addr = find_next_env_addr(addr, sector->addr + SECTOR_SIZE);
+
+            if (addr > sector->addr + SECTOR_SIZE || pre_env->len == 0) {
+                return FAILED_ADDR;
+            }
+        } else {
+            /* no ENV */
+            return FAILED_ADDR;
+        }
+    }
+
+    return addr;
+}
+
+/*
+ * Check the ENV length which is larger than sector, the big ENV is only on the head of combined sector.
+ */
+static bool env_len_is_ok(env_node_obj_t env)
+{
+    struct sector_meta_data sector;
+
+    if (env->len <= SECTOR_SIZE - SECTOR_HDR_DATA_SIZE) {
+        return true;
+    }
+    read_sector_meta_data(EF_ALIGN_DOWN(env->addr.start, SECTOR_SIZE), &sector, false);
+
+    return sector.check_ok && sector.combined != SECTOR_NOT_COMBINED
+            && env->addr.start == sector.addr + SECTOR_HDR_DATA_SIZE
+            && env->len <= get_sector_size(&sector) - SECTOR_HDR_DATA_SIZE - SECTOR_COMBINED_TABLE_SIZE(sector.combined);
+}
+
+/*
+ * Read the ENV header raw data, check and get the ENV status and length.
+ */
+static EfErrCode read_env_hdr_data(env_node_obj_t env, env_hdr_data_t env_hdr)
+{
+    /* read ENV header raw data */
+    flash_read(env->addr.start, (uint32_t *)env_hdr, sizeof(struct env_hdr_data));
+    env->status = (env_status_t) get_status(env_hdr->status_table, ENV_STATUS_NUM);
+    env->len = env_hdr->len;
+    env->crc_is_deferred = false;
+
+    if (env->len == ~0UL || env->len > ENV_AREA_SIZE || env->len < ENV_NAME_LEN_OFFSET || !env_len_is_ok(env)) {
+        /* the ENV length was not write, so reserved the meta data for current ENV */
+        env->len = ENV_HDR_DATA_SIZE;
+        if (env->status != ENV_ERR_HDR) {
+            env->status = ENV_ERR_HDR;
+            EF_DEBUG("Error: The ENV @0x%08X length has an error.\n", env->addr.start);
+            write_status(env->addr.start, env_hdr->status_table, ENV_STATUS_NUM, ENV_ERR_HDR);
+        }
+        env->crc_is_ok = false;
+        return EF_READ_ERR;
+    }
+
+    return EF_NO_ERR;
+}
+
+/*
+ * The counter ENV has a step table behind the value, @see ef_env_counter_inc
+ */
+static bool env_is_counter(uint32_t len, size_t name_len, size_t value_len)
+{
+    return value_len == sizeof(uint32_t)
+            && len == ENV_HDR_DATA_SIZE + EF_WG_ALIGN(name_len) + EF_WG_ALIGN(value_len) + ENV_COUNTER_TABLE_SIZE;
+}
+
+/*
+ * The reserved ENV name is used by the batch commit ENV, so it can NOT be set by user, @see commit_batch_env
+ */
+static bool env_name_is_reserved(const char *name, size_t name_len)
+{
+    return name_len == sizeof(BATCH_ENV_NAME) - 1 && !strncmp(name, BATCH_ENV_NAME, name_len);
+}
+
+/*
+ * Check the ENV length is consistent with the name and value length on ENV header.
+ * The compressed value must be smaller than the original value, @see create_env_blob
+ */
+static bool env_hdr_len_is_ok(uint32_t len, env_hdr_data_t env_hdr)
+{
+    uint32_t value_offset = ENV_HDR_DATA_SIZE + EF_WG_ALIGN(env_hdr->name_len);
+
+    if (!(env_hdr->flag & ENV_FLAG_COMPRESSED)) {
+        return len > value_offset && len < value_offset + EF_WG_ALIGN(env_hdr->value_len);
+    }
+
+    return len == value_offset + EF_WG_ALIGN(env_hdr->value_len)
+            || env_is_counter(len, env_hdr->name_len, env_hdr->value_len);
+}
+
+/*
+ * Calculate the ENV CRC32 value on flash.
+ */
+static uint32_t calc_env_crc32(env_node_obj_t env, env_hdr_data_t env_hdr)
+{
+    uint8_t buf[EF_READ_BUF_SIZE];
+    uint32_t calc_crc32 = 0, crc_data_len;
+    size_t len, size;
+
+    /* CRC32 data len(header.name_len + header.value_len + name + value) */
+    crc_data_len = env->len - ENV_NAME_LEN_OFFSET;
+    /* the counter step table is NOT in CRC32, it will be changed in place */
+    if (env_is_counter(env->len, env_hdr->name_len, env_hdr->value_len)) {
+        crc_data_len -= ENV_COUNTER_TABLE_SIZE;
+    }
+    /* calculate the CRC32 value */
+    for (len = 0, size = 0; len < crc_data_len; len += size) {
+        if (len + sizeof(buf) < crc_data_len) {
+            size = sizeof(buf);
+        } else {
+            size = crc_data_len - len;
+        }
+
+        flash_read(env->addr.start + ENV_NAME_LEN_OFFSET + len, (uint32_t *) buf, EF_WG_ALIGN(size));
+        calc_crc32 = ef_calc_crc32(calc_crc32, buf, size);
+    }
+
+    return calc_crc32;
+}
+
+static EfErrCode read_env(env_node_obj_t env)
+{
+    struct env_hdr_data env_hdr;
+    uint32_t env_name_addr;
+    EfErrCode result = EF_NO_ERR;
+
+    if (read_env_hdr_data(env, &env_hdr) != EF_NO_ERR) {
+        return EF_READ_ERR;
+    }
+    /* check CRC32 */
+    if (calc_env_crc32(env, &env_hdr) != env_hdr.crc32) {
+        env->crc_is_ok = false;
+        result = EF_READ_ERR;
+    } else {
+        env->crc_is_ok = true;
+        /* the name is behind aligned ENV header */
+        env_name_addr = env->addr.start + ENV_HDR_DATA_SIZE;
+        flash_read(env_name_addr, (uint32_t *) env->name, EF_WG_ALIGN(env_hdr.name_len));
+        /* the value is behind aligned name */
+        env->addr.value = env_name_addr + EF_WG_ALIGN(env_hdr.name_len);
+        env->value_len = env_hdr.value_len;
+        env->name_len = env_hdr.name_len;
+        env->crc32 = env_hdr.crc32;
+        env->is_compressed = !(env_hdr.flag & ENV_FLAG_COMPRESSED);
+    }
+
+    return result;
+}
+
+/*
+ * Only read the ENV header and name, the CRC32 check is deferred to check_env_crc().
+ * It will do the full read_env() when the header data is inconsistent.
+ */
+static EfErrCode read_env_hdr(env_node_obj_t env)
+{
+    struct env_hdr_data env_hdr;
+    uint32_t env_name_addr;
+
+    if (read_env_hdr_data(env, &env_hdr) != EF_NO_ERR) {
+        return EF_READ_ERR;
+    }
+    if (env_hdr.name_len > EF_ENV_NAME_MAX || !env_hdr_len_is_ok(env->len, &env_hdr)) {
+        return read_env(env);
+    }
+    env->crc_is_ok = false;
+    env->crc_is_deferred = true;
+    /* the name is behind aligned ENV header */
+    env_name_addr = env->addr.start + ENV_HDR_DATA_SIZE;
+    flash_read(env_name_addr, (uint32_t *) env->name, EF_WG_ALIGN(env_hdr.name_len));
+    /* the value is behind aligned name */
+    env->addr.value = env_name_addr + EF_WG_ALIGN(env_hdr.name_len);
+    env->value_len = env_hdr.value_len;
+    env->name_len = env_hdr.name_len;
+    env->crc32 = env_hdr.crc32;
+    env->is_compressed = !(env_hdr.flag & ENV_FLAG_COMPRESSED);
+
+    return EF_NO_ERR;
+}
+
+/*
+ * Check the deferred CRC32 of the ENV which is read by read_env_hdr().
+ */
+static bool check_env_crc(env_node_obj_t env)
+{
+    struct env_hdr_data env_hdr;
+
+    if (env->crc_is_deferred) {
+        flash_read(env->addr.start, (uint32_t *)&env_hdr, sizeof(struct env_hdr_data));
+        env->crc_is_ok = (calc_env_crc32(env, &env_hdr) == env_hdr.crc32);
+        env->crc_is_deferred = false;
+    }
+
+    return env->crc_is_ok;
+}
+
+/*
+ * Check the counter step is marked. The step is marked by one bit (EF_WRITE_GRAN is 1) or one write granularity.
+ */
+static bool counter_step_is_marked(uint32_t table_addr, size_t step)
+{
+    uint32_t step_data[(EF_WG_ALIGN(1) + 3) / 4];
+
+    if (step == 0) {
+        return true;
+    }
+#if (EF_WRITE_GRAN == 1)
+    flash_read(table_addr + (step - 1) / 8, step_data, 1);
+    return (((uint8_t *) step_data)[0] & (0x80 >> ((step - 1) % 8))) == 0x00;
+#else
+    flash_read(table_addr + (step - 1) * (EF_WRITE_GRAN / 8), step_data, EF_WRITE_GRAN / 8);
+    return ((uint8_t *) step_data)[0] == 0x00;
+#endif /* EF_WRITE_GRAN == 1 */
+}
+
+/*
+ * Read the marked step number of the counter ENV. The steps are marked in order, so using the binary search.
+ */
+static size_t read_counter_steps(uint32_t table_addr)
+{
+    size_t low = 0, high = EF_ENV_COUNTER_STEPS, mid;
+
+    while (low < high) {
+        mid = (low + high + 1) / 2;
+        if (counter_step_is_marked(table_addr, mid)) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    return low;
+}
+
+/*
+ * Mark the counter step in place. Same as the status table, every step is written only once.
+ */
+static EfErrCode mark_counter_step(uint32_t table_addr, size_t step)
+{
+    uint32_t step_data[(EF_WG_ALIGN(1) + 3) / 4];
+
+    EF_ASSERT(step > 0 && step <= EF_ENV_COUNTER_STEPS);
+
+#if (EF_WRITE_GRAN == 1)
+    ((uint8_t *) step_data)[0] = ~(0x80 >> ((step - 1) % 8));
+    return flash_write(table_addr + (step - 1) / 8, step_data, 1);
+#else
+    memset(step_data, 0x00, sizeof(step_data));
+    return flash_write(table_addr + (step - 1) * (EF_WRITE_GRAN / 8), step_data, EF_WRITE_GRAN / 8);
+#endif /* EF_WRITE_GRAN == 1 */
+}
+
+#ifdef EF_ENV_USING_COMPRESS
+struct value_reader {
+    uint32_t addr;                               /**< the next read address */
+    uint32_t end;                                /**< the end address */
+    size_t pos;                                  /**< the read position on buffer */
+    size_t size;                                 /**< the data size on buffer */
+    uint8_t buf[EF_READ_BUF_SIZE];               /**< the read buffer */
+};
+
+static bool read_value_byte(struct value_reader *reader, uint8_t *data)
+{
+    if (reader->pos == reader->size) {
+        if (reader->addr >= reader->end) {
+            return false;
+        }
+        if (reader->end - reader->addr < sizeof(reader->buf)) {
+            reader->size = reader->end - reader->addr;
+        } else {
+            reader->size = sizeof(reader->buf);
+        }
+        flash_read(reader->addr, (uint32_t *) reader->buf, reader->size);
+        reader->addr += reader->size;
+        reader->pos = 0;
+    }
+    *data = reader->buf[reader->pos++];
+
+    return true;
+}
+
+struct value_decoder {
+    uint32_t env_addr;                           /**< the decompressing ENV address, FAILED_ADDR: NOT started */
+    uint32_t crc32;                              /**< the decompressing ENV CRC32 */
+    size_t out;                                  /**< the decompressed length */
+    size_t run;                                  /**< the remain length of current token */
+    size_t distance;                             /**< the match distance of current token, 0: literal */
+    struct value_reader reader;                  /**< the compressed data reader */
+    uint8_t window[ENV_COMPRESS_WINDOW];         /**< the decompressed data window */
+};
+
+/* the decompressing state of last read, so the chunk by chunk read will NOT decompress from the start every time */
+static struct value_decoder value_decoder = { FAILED_ADDR };
+
+/*
+ * Decompress the ENV value to the offset, and only the data from the offset will be saved to buffer.
+ * It's resumed from last read when the offset is NOT before the decompressed length of same ENV,
+ * otherwise it's decompressed from the start.
+ * The compressed value is LZ77 tokens. The literal token (0x00~0x7F) is the literal length - 1 and followed by
+ * literal data. The match token (0x80~0xFF) low 7 bits is the match length - ENV_COMPRESS_MIN_MATCH and followed by
+ * 1 byte match distance - 1.
+ */
+static size_t read_compressed_value(env_node_obj_t env, size_t offset, uint8_t *value_buf, size_t len)
+{
+    struct value_decoder *decoder = &value_decoder;
+    uint8_t token, data;
+
+    if (decoder->env_addr != env->addr.start || decoder->crc32 != env->crc32 || decoder->out > offset) {
+        decoder->env_addr = env->addr.start;
+        decoder->crc32 = env->crc32;
+        decoder->out = decoder->run = decoder->distance = 0;
+        decoder->reader.addr = env->addr.value;
+        decoder->reader.end = env->addr.start + env->len;
+        decoder->reader.pos = decoder->reader.size = 0;
+    }
+
+    while (decoder->out < offset + len) {
+        if (decoder->run == 0) {
+            if (!read_value_byte(&decoder->reader, &token)) {
+                break;
+            }
+            if (token < 0x80) {
+                decoder->run = token + 1;
+                decoder->distance = 0;
+            } else {
+                decoder->run = (token & 0x7F) + ENV_COMPRESS_MIN_MATCH;
+                if (!read_value_byte(&decoder->reader, &data) || (decoder->distance = data + 1) > decoder->out) {
+                    /* the compressed data is broken, decompress from the start on next read */
+                    decoder->env_addr = FAILED_ADDR;
+                    break;
+                }
+            }
+        }
+        if (decoder->distance) {
+            data = decoder->window[(decoder->out - decoder->distance) % ENV_COMPRESS_WINDOW];
+        } else if (!read_value_byte(&decoder->reader, &data)) {
+            decoder->env_addr = FAILED_ADDR;
+            break;
+        }
+        decoder->window[decoder->out % ENV_COMPRESS_WINDOW] = data;
+        if (decoder->out >= offset) {
+            value_buf[decoder->out - offset] = data;
+        }
+        decoder->out++;
+        decoder->run--;
+    }
+
+    return decoder->out > offset ? decoder->out - offset : 0;
+}
+#endif /* EF_ENV_USING_COMPRESS */
+
+/*
+ * Read the ENV value from the offset. The counter ENV value is the saved value plus the marked step number.
+ */
+static size_t read_env_value(env_node_obj_t env, size_t offset, void *value_buf, size_t len)
+{
+    if (env_is_counter(env->len, env->name_len, env->value_len)) {
+        uint32_t counter;
+
+        flash_read(env->addr.value, &counter, sizeof(uint32_t));
+        counter += read_counter_steps(env->addr.value + EF_WG_ALIGN(env->value_len));
+        memcpy(value_buf, (uint8_t *) &counter + offset, len);
+    } else if (env->is_compressed) {
+#ifdef EF_ENV_USING_COMPRESS
+        return read_compressed_value(env, offset, value_buf, len);
+#else
+        EF_INFO("Error: The ENV (%.*s) value is compressed, please enable EF_ENV_USING_COMPRESS.\n", env->name_len,
+                env->name);
+        return 0;
+#endif /* EF_ENV_USING_COMPRESS */
+    } else {
+        flash_read(env->addr.value + offset, (uint32_t *) value_buf, len);
+    }
+
+    return len;
+}
+
+static EfErrCode read_sector_meta_data(uint32_t addr, sector_meta_data_t sector, bool traversal)
+{
+    EfErrCode result = EF_NO_ERR;
+    struct sector_hdr_data sec_hdr;
+
+    EF_ASSERT(addr % SECTOR_SIZE == 0);
+    EF_ASSERT(sector);
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+    /* the map has all sector meta data, don't need to read flash */
+    if (get_sector_from_map(addr, sector)) {
+        return sector->check_ok ? EF_NO_ERR : EF_ENV_INIT_FAILED;
+    }
+#endif /* EF_ENV_USING_SECTOR_MAP */
+
+    /* read sector header raw data */
+    flash_read(addr, (uint32_t *)&sec_hdr, sizeof(struct sector_hdr_data));
+
+    sector->addr = addr;
+    sector->magic = sec_hdr.magic;
+    /* check magic word */
+    if (sector->magic != SECTOR_MAGIC_WORD) {
+        sector->check_ok = false;
+        sector->combined = SECTOR_NOT_COMBINED;
+        sector->erase_count = 0;
+        return EF_ENV_INIT_FAILED;
+    }
+    sector->check_ok = true;
+    /* get other sector meta data, the invalid combined sector number will be ignored */
+    sector->combined = sec_hdr.combined;
+    if (sector->combined < 2 || sector->combined > (env_start_addr + ENV_AREA_SIZE - addr) / SECTOR_SIZE) {
+        sector->combined = SECTOR_NOT_COMBINED;
+    }
+    /* the sector which is formatted by old version has NOT erase count */
+    sector->erase_count = sec_hdr.erase_count == 0xFFFFFFFF ? 0 : sec_hdr.erase_count;
+    sector->status.store = (sector_store_status_t) get_status(sec_hdr.status_table.store, SECTOR_STORE_STATUS_NUM);
+    sector->status.dirty = (sector_dirty_status_t) get_status(sec_hdr.status_table.dirty, SECTOR_DIRTY_STATUS_NUM);
+    /* traversal all ENV and calculate the remain space size */
+    if (traversal) {
+        sector->remain = 0;
+        sector->empty_env = sector->addr + SECTOR_HDR_DATA_SIZE;
+        if (sector->status.store == SECTOR_STORE_EMPTY) {
+            sector->remain = SECTOR_SIZE - SECTOR_HDR_DATA_SIZE;
+        } else if (sector->status.store == SECTOR_STORE_USING) {
+            struct env_node_obj env_meta;
+
+#ifdef EF_ENV_USING_CACHE
+            if (get_sector_from_cache(addr, &sector->empty_env)) {
+                sector->remain = SECTOR_SIZE - (sector->empty_env - sector->addr);
+                return result;
+            }
+#endif /* EF_ENV_USING_CACHE */
+
+            sector->remain = SECTOR_SIZE - SECTOR_HDR_DATA_SIZE;
+            env_meta.addr.start = FAILED_ADDR;
+            while ((env_meta.addr.start = get_next_env_addr(sector, &env_meta)) != FAILED_ADDR) {
+                read_env(&env_meta);
+                if (!env_meta.crc_is_ok) {
+                    if (env_meta.status != ENV_PRE_WRITE && env_meta.status!= ENV_ERR_HDR) {
+                        EF_INFO("Error: The ENV (@0x%08X) CRC32 check failed!\n", env_meta.addr.start);
+                        sector->remain = 0;
+                        result = EF_READ_ERR;
+                        break;
+                    }
+                }
+                sector->empty_env += env_meta.len;
+                sector->remain -= env_meta.len;
+            }
+            /* check the empty ENV address by read continue 0xFF on flash  */
+            {
+                uint32_t ff_addr;
+
+                ff_addr = continue_ff_addr(sector->empty_env, sector->addr + SECTOR_SIZE);
+                /* check the flash data is clean */
+                if (sector->empty_env != ff_addr) {
+                    /* update the sector information */
+                    sector->empty_env = ff_addr;
+                    sector->remain = SECTOR_SIZE - (ff_addr - sector->addr);
+                }
+            }
+
+#ifdef EF_ENV_USING_CACHE
+            update_sector_cache(sector->addr, sector->empty_env);
+#endif
+        }
+    }
+
+    return result;
+}
+
+static uint32_t get_next_sector_addr(sector_meta_data_t pre_sec)
+{
+    uint32_t next_addr;
+
+    if (pre_sec->addr == FAILED_ADDR) {
+        return env_start_addr;
+    } else {
+        /* check ENV sector combined */
+        if (pre_sec->combined == SECTOR_NOT_COMBINED) {
+            next_addr = pre_sec->addr + SECTOR_SIZE;
+        } else {
+            next_addr = pre_sec->addr + pre_sec->combined * SECTOR_SIZE;
+        }
+        /* check range */
+        if (next_addr < env_start_addr + ENV_AREA_SIZE) {
+            return next_addr;
+        } else {
+            /* no sector */
+            return FAILED_ADDR;
+        }
+    }
+}
+
+/*
+ * Iterate all ENV. The ENV CRC32 check will be deferred to callback when check_crc is false.
+ */
+static void env_iterator(env_node_obj_t env, void *arg1, void *arg2,
+        bool (*callback)(env_node_obj_t env, void *arg1, void *arg2), bool check_crc)
+{
+    struct sector_meta_data sector;
+    uint32_t sec_addr;
+
+    sector.addr = FAILED_ADDR;
+    /* search all sectors */
+    while ((sec_addr = get_next_sector_addr(&sector)) != FAILED_ADDR) {
+        if (read_sector_meta_data(sec_addr, &sector, false) != EF_NO_ERR) {
+            continue;
+        }
+        if (callback == NULL) {
+            continue;
+        }
+        /* sector has ENV */
+        if (sector.status.store == SECTOR_STORE_USING || sector.status.store == SECTOR_STORE_FULL) {
+            env->addr.start = FAILED_ADDR;
+            /* search all ENV */
+            while ((env->addr.start = get_next_env_addr(&sector, env)) != FAILED_ADDR) {
+                if (check_crc) {
+                    read_env(env);
+                } else {
+                    read_env_hdr(env);
+                }
+                /* iterator is interrupted when callback return true */
+                if (callback(env, arg1, arg2)) {
+                    return;
+                }
+            }
+        }
+    }
+}
+
+static bool find_env_cb(env_node_obj_t env, void *arg1, void *arg2)
+{
+    const char *key = arg1;
+    bool *find_ok = arg2;
+    size_t key_len = strlen(key);
+
+    if (key_len != env->name_len) {
+        return false;
+    }
+    /* check ENV, the CRC32 check is only for the name matched ENV */
+    if (env->status == ENV_WRITE && !strncmp(env->name, key, key_len) && check_env_crc(env)) {
+        *find_ok = true;
+        return true;
+    }
+    return false;
+}
+
+static bool find_env_no_cache(const char *key, env_node_obj_t env)
+{
+    bool find_ok = false;
+
+    env_iterator(env, (void *)key, &find_ok, find_env_cb, false);
+
+    return find_ok;
+}
+
+#if defined(EF_ENV_USING_SECTOR_MAP) || (EF_GC_POLICY != EF_GC_POLICY_ALL)
+/*
+ * Calculate the live (ENV_WRITE and ENV_PRE_DELETE) ENV total bytes and the used bytes on the sector by flash.
+ */
+static void calc_sector_usage(sector_meta_data_t sector, size_t *live, size_t *used)
+{
+    struct env_node_obj env;
+
+    *live = 0;
+    *used = 0;
+    if (sector->check_ok && (sector->status.store == SECTOR_STORE_USING || sector->status.store == SECTOR_STORE_FULL)) {
+        env.addr.start = FAILED_ADDR;
+        while ((env.addr.start = get_next_env_addr(sector, &env)) != FAILED_ADDR) {
+            read_env_hdr(&env);
+            if ((env.crc_is_ok || env.crc_is_deferred) && (env.status == ENV_WRITE || env.status == ENV_PRE_DELETE)) {
+                *live += env.len;
+            }
+            if (env.addr.start + env.len <= sector->addr + get_sector_size(sector)) {
+                *used = env.addr.start + env.len - sector->addr - SECTOR_HDR_DATA_SIZE;
+            }
+        }
+    }
+}
+#endif /* defined(EF_ENV_USING_SECTOR_MAP) || (EF_GC_POLICY != EF_GC_POLICY_ALL) */
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+/*
+ * Load the sector meta data and live ENV size from flash to map.
+ */
+static void load_sector_map(uint32_t sec_addr)
+{
+    struct sector_meta_data sector;
+    sector_map_node_t node = &sector_map_table[(sec_addr - env_start_addr) / SECTOR_SIZE];
+    size_t live, used;
+
+    read_sector_meta_data(sec_addr, &sector, true);
+    node->check_ok = sector.check_ok;
+    node->combined = sector.combined;
+    node->erase_count = sector.erase_count;
+    node->write_seq = sector_map_full_seq;
+    if (!sector.check_ok) {
+        node->store = SECTOR_STORE_UNUSED;
+        node->dirty = SECTOR_DIRTY_UNUSED;
+        node->empty_env = sec_addr + SECTOR_HDR_DATA_SIZE;
+        node->remain = 0;
+        node->live = 0;
+        return;
+    }
+    node->store = sector.status.store;
+    node->dirty = sector.status.dirty;
+    node->empty_env = sector.empty_env;
+    node->remain = sector.remain;
+    calc_sector_usage(&sector, &live, &used);
+    node->live = live;
+    /* the full sector's empty ENV address is NOT traversal by read_sector_meta_data */
+    if (sector.status.store == SECTOR_STORE_FULL) {
+        node->empty_env = sec_addr + SECTOR_HDR_DATA_SIZE + used;
+        node->remain = get_sector_size(&sector) - SECTOR_HDR_DATA_SIZE - used;
+    }
+}
+
+/*
+ * Reload the sector on map from flash. It's used when the sector has been written failed.
+ */
+static void reload_sector_map(uint32_t sec_addr)
+{
+    if (sector_map_ok) {
+        sector_map_ok = false;
+        load_sector_map(EF_ALIGN_DOWN(sec_addr, SECTOR_SIZE));
+        sector_map_ok = true;
+    }
+}
+
+static void sector_map_build(void)
+{
+    uint32_t sec_addr;
+
+    sector_map_ok = false;
+    for (sec_addr = env_start_addr; sec_addr < env_start_addr + ENV_AREA_SIZE; sec_addr += SECTOR_SIZE) {
+        load_sector_map(sec_addr);
+    }
+    sector_map_ok = true;
+}
+#endif /* EF_ENV_USING_SECTOR_MAP */
+
+#ifdef EF_ENV_USING_BLOOM
+static void env_bloom_reset(void)
+{
+    memset(env_bloom_table, 0x00, sizeof(env_bloom_table));
+    env_bloom_stat.keys = 0;
+    env_bloom_stat.stale = 0;
+    env_bloom_ok = true;
+}
+
+/*
+ * Get the two base hash values for double hashing. The first is CRC32, the second is FNV-1a.
+ */
+static void env_bloom_hash(const char *name, size_t name_len, uint32_t *h1, uint32_t *h2)
+{
+    size_t i;
+
+    *h1 = ef_calc_crc32(0, name, name_len);
+    *h2 = 2166136261UL;
+    for (i = 0; i < name_len; i++) {
+        *h2 = (*h2 ^ (uint8_t) name[i]) * 16777619UL;
+    }
+    /* make sure all bits can be reached */
+    *h2 |= 1;
+}
+
+static void env_bloom_add(const char *name, size_t name_len)
+{
+    uint32_t h1, h2, bit;
+    size_t i;
+    bool is_new = false;
+
+    env_bloom_hash(name, name_len, &h1, &h2);
+    for (i = 0; i < ENV_BLOOM_HASH_NUM; i++) {
+        bit = (h1 + i * h2) % ENV_BLOOM_BITS;
+        if (!(env_bloom_table[bit / 8] & (1 << (bit % 8)))) {
+            env_bloom_table[bit / 8] |= 1 << (bit % 8);
+            is_new = true;
+        }
+    }
+    /* the ENV is already in filter when all bits has been set */
+    if (is_new) {
+        env_bloom_stat.keys++;
+    }
+}
+
+/*
+ * It's return false when the ENV is definitely NOT on flash.
+ */
+static bool env_bloom_check(const char *name, size_t name_len)
+{
+    uint32_t h1, h2, bit;
+    size_t i;
+
+    env_bloom_hash(name, name_len, &h1, &h2);
+    for (i = 0; i < ENV_BLOOM_HASH_NUM; i++) {
+        bit = (h1 + i * h2) % ENV_BLOOM_BITS;
+        if (!(env_bloom_table[bit / 8] & (1 << (bit % 8)))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool env_bloom_rebuild_cb(env_node_obj_t env, void *arg1, void *arg2)
+{
+    if ((env->crc_is_ok || env->crc_is_deferred) && env->status == ENV_WRITE) {
+        env_bloom_add(env->name, env->name_len);
+    }
+
+    return false;
+}
+
+/*
+ * The deleted ENV can NOT be removed from filter, so rebuild it when there has too many stale ENV.
+ */
+static void env_bloom_rebuild(void)
+{
+    struct env_node_obj env;
+
+    EF_DEBUG("Rebuild the ENV bloom filter, it has %d stale ENV in %d ENV.\n", env_bloom_stat.stale,
+            env_bloom_stat.keys);
+    env_bloom_reset();
+    /* the ENV which CRC32 check failed is harmless for filter, so skip the CRC32 check */
+    env_iterator(&env, NULL, NULL, env_bloom_rebuild_cb, false);
+    env_bloom_stat.rebuild++;
+}
+#endif /* EF_ENV_USING_BLOOM */
+
+static bool find_env(const char *key, env_node_obj_t env)
+{
+    bool find_ok = false;
+
+#if defined(EF_ENV_USING_CACHE) || defined(EF_ENV_USING_INDEX) || defined(EF_ENV_USING_BLOOM)
+    size_t key_len = strlen(key);
+#endif
+
+#ifdef EF_ENV_USING_BLOOM
+    if (env_bloom_ok && !in_recovery_check) {
+        env_bloom_stat.query++;
+        if (!env_bloom_check(key, key_len)) {
+            /* the ENV is definitely NOT on flash */
+            env_bloom_stat.reject++;
+            return false;
+        }
+    }
+#endif /* EF_ENV_USING_BLOOM */
+
+#ifdef EF_ENV_USING_CACHE
+    if (get_env_from_cache(key, key_len, env)) {
+        return true;
+    }
+#endif /* EF_ENV_USING_CACHE */
+
+#ifdef EF_ENV_USING_INDEX
+    if (env_index_ok && !in_recovery_check) {
+        if (!get_env_from_index(key, key_len, &env->addr.start)) {
+            /* the index table has all ENV, so it's NOT on flash */
+            return false;
+        }
+        read_env(env);
+        if (env->crc_is_ok && env->status == ENV_WRITE) {
+            find_ok = true;
+        } else {
+            /* the saved address is expired, find it again and fix the index */
+            delete_env_index(key, key_len, env->addr.start);
+            if ((find_ok = find_env_no_cache(key, env)) == true) {
+                update_env_index(key, key_len, env->addr.start);
+            }
+        }
+    } else {
+        find_ok = find_env_no_cache(key, env);
+    }
+#else
+    find_ok = find_env_no_cache(key, env);
+#endif /* EF_ENV_USING_INDEX */
+
+#ifdef EF_ENV_USING_BLOOM
+    if (!find_ok && env_bloom_ok && !in_recovery_check) {
+        env_bloom_stat.false_positive++;
+    }
+#endif
+
+#ifdef EF_ENV_USING_CACHE
+    if (find_ok) {
+        update_env_cache(key, key_len, env->addr.start);
+    }
+#endif /* EF_ENV_USING_CACHE */
+
+    return find_ok;
+}
+
+static bool ef_is_str(uint8_t *value, size_t len)
+{
+#define __is_print(ch)       ((unsigned int)((ch) - ' ') < 127u - ' ')
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (!__is_print(value[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static size_t get_env(const char *key, void *value_buf, size_t buf_len, size_t *value_len)
+{
+    struct env_node_obj env;
+    size_t read_len = 0;
+
+    if (find_env(key, &env)) {
+        if (value_len) {
+            *value_len = env.value_len;
+        }
+        if (buf_len > env.value_len) {
+            read_len = env.value_len;
+        } else {
+            read_len = buf_len;
+        }
+        if (value_buf){
+            read_len = read_env_value(&env, 0, value_buf, read_len);
+        }
+    } else if (value_len) {
+        *value_len = 0;
+    }
+
+    return read_len;
+}
+
+/**
+ * Get a ENV object by key name
+ *
+ * @param key ENV name
+ * @param env ENV object
+ *
+ * @return TRUE: find the ENV is OK, else return false
+ */
+bool ef_get_env_obj(const char *key, env_node_obj_t env)
+{
+    bool find_ok = false;
+
+    if (!init_ok) {
+        EF_INFO("ENV isn't initialize OK.\n");
+        return 0;
+    }
+
+    /* lock the ENV cache */
+    ef_port_env_lock();
+
+    find_ok = find_env(key, env);
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
+
+    return find_ok;
+}
+
+/**
+ * Get a blob ENV value by key name.
+ *
+ * @param key ENV name
+ * @param value_buf ENV blob buffer
+ * @param buf_len ENV blob buffer length
+ * @param saved_value_len return the length of the value saved on the flash, 0: NOT found
+ *
+ * @return the actually get size on successful
+ */
+size_t ef_get_env_blob(const char *key, void *value_buf, size_t buf_len, size_t *saved_value_len)
+{
+    size_t read_len = 0;
+
+    if (!init_ok) {
+        EF_INFO("ENV isn't initialize OK.\n");
+        return 0;
+    }
+
+    /* lock the ENV cache */
+    ef_port_env_lock();
+
+    read_len = get_env(key, value_buf, buf_len, saved_value_len);
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
+
+    return read_len;
+}
+
+/**
+ * Get an ENV value by key name.
+ *
+ * @note this function is NOT supported reentrant
+ * @note this function is DEPRECATED
+ *
+ * @param key ENV name
+ *
+ * @return value
+ */
+char *ef_get_env(const char *key)
+{
+    static char value[EF_STR_ENV_VALUE_MAX_SIZE + 1];
+    size_t get_size;
+
+    if ((get_size = ef_get_env_blob(key, value, EF_STR_ENV_VALUE_MAX_SIZE, NULL)) > 0) {
+        /* the return value must be string */
+        if (ef_is_str((uint8_t *)value, get_size)) {
+            value[get_size] = '\0';
+            return value;
+        } else {
+            EF_INFO("Warning: The ENV value isn't string. Could not be returned\n");
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * read the ENV value by ENV object
+ *
+ * @param env ENV object
+ * @param value_buf the buffer for store ENV value
+ * @param buf_len buffer length
+ *
+ * @return the actually read size on successful
+ */
+size_t ef_read_env_value(env_node_obj_t env, uint8_t *value_buf, size_t buf_len)
+{
+    size_t read_len = 0;
+
+    EF_ASSERT(env);
+    EF_ASSERT(value_buf);
+
+    if (!init_ok) {
+        EF_INFO("ENV isn't initialize OK.\n");
+        return 0;
+    }
+
+    if (env->crc_is_ok) {
+        /* lock the ENV cache */
+        ef_port_env_lock();
+
+        if (buf_len > env->value_len) {
+            read_len = env->value_len;
+        } else {
+            read_len = buf_len;
+        }
+
+        read_len = read_env_value(env, 0, value_buf, read_len);
+        /* unlock the ENV cache */
+        ef_port_env_unlock();
+    }
+
+    return read_len;
+}
+
+/*
+ * Check the ENV object is still same as the ENV on flash. The other ENV which has same size maybe moved to
+ * the same address by GC, so the CRC32 and name are checked too.
+ */
+static bool env_obj_is_unchanged(env_node_obj_t env)
+{
+    struct env_hdr_data env_hdr;
+    char saved_name[EF_ENV_NAME_MAX];
+
+    flash_read(env->addr.start, (uint32_t *)&env_hdr, sizeof(struct env_hdr_data));
+    if (env_hdr.magic != ENV_MAGIC_WORD || env_hdr.len != env->len || env_hdr.value_len != env->value_len
+            || env_hdr.crc32 != env->crc32 || env_hdr.name_len != env->name_len
+            || get_status(env_hdr.status_table, ENV_STATUS_NUM) != ENV_WRITE) {
+        return false;
+    }
+    flash_read(env->addr.start + ENV_HDR_DATA_SIZE, (uint32_t *) saved_name, EF_WG_ALIGN(env->name_len));
+
+    return !strncmp(env->name, saved_name, env->name_len);
+}
+
+/**
+ * Read the ENV value from the offset. The large ENV value can be read by a small buffer chunk by chunk.
+ * It's return 0 when the ENV has been changed, deleted or moved by GC, so please get the ENV object again.
+ *
+ * @param env the ENV object which is got by ef_get_env_obj
+ * @param offset the value offset
+ * @param value_buf the value buffer
+ * @param buf_len the value buffer length
+ *
+ * @return the actually read length
+ */
+size_t ef_read_env_value_at(env_node_obj_t env, size_t offset, uint8_t *value_buf, size_t buf_len)
+{
+    size_t read_len = 0;
+
+    EF_ASSERT(env);
+    EF_ASSERT(value_buf);
+
+    if (!init_ok) {
+        EF_INFO("ENV isn't initialize OK.\n");
+        return 0;
+    }
+
+    if (env->crc_is_ok && offset < env->value_len) {
+        /* lock the ENV cache */
+        ef_port_env_lock();
+
+        /* the ENV maybe changed after the ENV object is got */
+        if (env_obj_is_unchanged(env)) {
+            if (buf_len > env->value_len - offset) {
+                read_len = env->value_len - offset;
+            } else {
+                read_len = buf_len;
+            }
+            read_len = read_env_value(env, offset, value_buf, read_len);
+        }
+
+        /* unlock the ENV cache */
+        ef_port_env_unlock();
+    }
+
+    return read_len;
+}
+
+/**
+ * Get the ENV value pointer on the memory mapped flash (EF_ENV_USING_XIP), the value can be used in place without copy.
+ * The sector of the ENV will NOT be collected by GC until the pointer is released by ef_release_env_ptr.
+ * So the value on pointer will NOT be changed even if the ENV is changed or deleted.
+ * @note please release the pointer as soon as possible, and it must be released before ef_env_set_default.
+ *
+ * @param key ENV name
+ * @param value_len the saved value length, it will NOT be set when it's NULL
+ *
+ * @return the ENV value pointer, NULL: the ENV is NOT found, compressed, counter or the pin table is full
+ */
+const void *ef_get_env_ptr(const char *key, size_t *value_len)
+{
+    const void *value = NULL;
+
+#ifdef EF_ENV_USING_XIP
+    struct env_node_obj env;
+    bool find_ok;
+    size_t i;
+
+    if (!init_ok) {
+        EF_INFO("ENV isn't initialize OK.\n");
+        return NULL;
+    }
+
+    /* lock the ENV cache */
+    ef_port_env_lock();
+
+    find_ok = find_env(key, &env);
+    if (find_ok && (env.is_compressed || env_is_counter(env.len, env.name_len, env.value_len))) {
+        /* the compressed or counter ENV value on flash is NOT the current value, @see ef_env_counter_inc */
+        EF_INFO("Error: The compressed or counter ENV (%s) value can NOT be used in place.\n", key);
+    } else if (find_ok) {
+        for (i = 0; i < EF_ENV_PIN_TABLE_SIZE; i++) {
+            if (env_pin_table[i] == 0) {
+                /* pin the ENV, its sector will NOT be collected */
+                env_pin_table[i] = env.addr.value;
+                value = EF_ENV_XIP_ADDR(env.addr.value);
+                if (value_len) {
+                    *value_len = env.value_len;
+                }
+                break;
+            }
+        }
+        if (value == NULL) {
+            EF_INFO("Error: The ENV pin table is full, please release the unused ENV pointer.\n");
+        }
+    }
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
+#endif /* EF_ENV_USING_XIP */
+
+    return value;
+}
+
+/**
+ * Release the ENV value pointer which is got by ef_get_env_ptr. The pointer can NOT be used after released.
+ *
+ * @param value the ENV value pointer
+ */
+void ef_release_env_ptr(const void *value)
+{
+#ifdef EF_ENV_USING_XIP
+    size_t i;
+
+    /* lock the ENV cache */
+    ef_port_env_lock();
+
+    for (i = 0; i < EF_ENV_PIN_TABLE_SIZE; i++) {
+        if (env_pin_table[i] != 0 && EF_ENV_XIP_ADDR(env_pin_table[i]) == value) {
+            env_pin_table[i] = 0;
+            break;
+        }
+    }
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
+#endif /* EF_ENV_USING_XIP */
+}
+
+/**
+ * Get the ENV negative lookup bloom filter statistics.
+ * The statistics will be all 0 when the bloom filter is disabled.
+ *
+ * @param stats the statistics
+ */
+void ef_get_env_bloom_stats(env_bloom_stats_t stats)
+{
+    EF_ASSERT(stats);
+
+#ifdef EF_ENV_USING_BLOOM
+    /* lock the ENV cache */
+    ef_port_env_lock();
+
+    *stats = env_bloom_stat;
+    stats->bits = ENV_BLOOM_BITS;
+    stats->hash_num = ENV_BLOOM_HASH_NUM;
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
+#else
+    memset(stats, 0x00, sizeof(struct env_bloom_stats));
+#endif /* EF_ENV_USING_BLOOM */
+}
+
+/**
+ * Get the ENV read cache statistics.
+ * The statistics will be all 0 when the read cache is disabled.
+ *
+ * @param stats the statistics
+ */
+void ef_get_env_read_cache_stats(env_read_cache_stats_t stats)
+{
+    EF_ASSERT(stats);
+
+#ifdef EF_ENV_USING_READ_CACHE
+    /* lock the ENV cache */
+    ef_port_env_lock();
+
+    *stats = read_cache_stat;
+    stats->pages = EF_ENV_READ_CACHE_PAGE_NUM;
+    stats->page_size = EF_ENV_READ_CACHE_PAGE_SIZE;
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
+#else
+    memset(stats, 0x00, sizeof(struct env_read_cache_stats));
+#endif /* EF_ENV_USING_READ_CACHE */
+}
+
+/**
+ * Scrub the ENV cache. All cached ENV will be verified by CRC32 again when it's got next time.
+ * It's useful when the flash data maybe corrupted, such as the flash is written by others.
+ */
+void ef_env_cache_scrub(void)
+{
+#ifdef EF_ENV_USING_CACHE
+    /* lock the ENV cache */
+    ef_port_env_lock();
+
+    unverify_env_cache(env_start_addr, ENV_AREA_SIZE);
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
+#endif /* EF_ENV_USING_CACHE */
+}
+
+
+/*
+ * Erase the sector and write the empty sector header with the erase count.
+ */
+static EfErrCode erase_sector(uint32_t addr, uint32_t combined_value, uint32_t erase_count)
+{
+    EfErrCode result = EF_NO_ERR;
+    struct sector_hdr_data sec_hdr;
+
+    EF_ASSERT(addr % SECTOR_SIZE == 0);
+
+    result = flash_erase(addr, SECTOR_SIZE);
+    if (result == EF_NO_ERR) {
+        /* initialize the header data */
+        memset(&sec_hdr, 0xFF, sizeof(struct sector_hdr_data));
+        set_status(sec_hdr.status_table.store, SECTOR_STORE_STATUS_NUM, SECTOR_STORE_EMPTY);
+        set_status(sec_hdr.status_table.dirty, SECTOR_DIRTY_STATUS_NUM, SECTOR_DIRTY_FALSE);
+        sec_hdr.magic = SECTOR_MAGIC_WORD;
+        sec_hdr.combined = combined_value;
+        sec_hdr.erase_count = erase_count;
+        /* save the header */
+        result = flash_write(addr, (uint32_t *)&sec_hdr, sizeof(struct sector_hdr_data));
+
+#ifdef EF_ENV_USING_CACHE
+        /* delete the sector cache */
+        update_sector_cache(addr, addr + SECTOR_SIZE);
+        /* the cached ENV on this sector has been erased */
+        unverify_env_cache(addr, SECTOR_SIZE);
+#endif /* EF_ENV_USING_CACHE */
+
+#ifdef EF_ENV_USING_INDEX
+        /* all ENV on this sector has been erased */
+        delete_sector_env_index(addr);
+#endif
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+        reset_sector_map(addr, combined_value, erase_count, result == EF_NO_ERR);
+#endif
+    }
+
+    return result;
+}
+
+static EfErrCode format_sector(uint32_t addr, uint32_t combined_value)
+{
+    struct sector_meta_data sector;
+    uint32_t erase_count;
+
+    /* carry the erase count to new header, it will be lost when the power is down before the header is written */
+    read_sector_meta_data(addr, &sector, false);
+    erase_count = sector.erase_count < 0xFFFFFFFE ? sector.erase_count + 1 : 0xFFFFFFFE;
+
+    return erase_sector(addr, combined_value, erase_count);
+}
+
+/*
+ * Read the erase count of the other combined sector from the erase count table, @see alloc_combined_env
+ * The count on the sector header is used when it's NOT on table (the power is down when the sectors are combined).
+ */
+static uint32_t read_combined_erase_count(sector_meta_data_t sector, uint32_t index)
+{
+    struct sector_meta_data other;
+    uint32_t erase_count;
+
+    flash_read(sector->addr + get_sector_size(sector) - SECTOR_COMBINED_TABLE_SIZE(sector->combined)
+            + (index - 1) * EF_WG_ALIGN(sizeof(uint32_t)), &erase_count, sizeof(uint32_t));
+    if (erase_count == 0xFFFFFFFF) {
+        if (read_sector_meta_data(sector->addr + index * SECTOR_SIZE, &other, false) == EF_NO_ERR) {
+            erase_count = other.erase_count;
+        } else {
+            erase_count = sector->erase_count;
+        }
+    }
+
+    return erase_count;
+}
+
+/*
+ * Format the sector which maybe combined, all combined sectors will be formatted to the not combined sector.
+ * The other sectors header has been erased when they are combined, so their erase count is restored from the table.
+ */
+static EfErrCode format_combined_sector(sector_meta_data_t sector)
+{
+    EfErrCode result = EF_NO_ERR;
+    uint32_t i, erase_count;
+
+    if (sector->combined != SECTOR_NOT_COMBINED) {
+        /* format the other sectors first, they are still hidden by the first sector until it's formatted.
+         * the last sector which has the erase count table is formatted at the end */
+        for (i = 1; i < sector->combined && result == EF_NO_ERR; i++) {
+            erase_count = read_combined_erase_count(sector, i);
+            erase_count = erase_count < 0xFFFFFFFE ? erase_count + 1 : 0xFFFFFFFE;
+            result = erase_sector(sector->addr + i * SECTOR_SIZE, SECTOR_NOT_COMBINED, erase_count);
+        }
+        if (result != EF_NO_ERR) {
+            return result;
+        }
+    }
+
+    return format_sector(sector->addr, SECTOR_NOT_COMBINED);
+}
+
+static EfErrCode update_sec_status(sector_meta_data_t sector, size_t new_env_len, bool *is_full)
+{
+    uint8_t status_table[STORE_STATUS_TABLE_SIZE];
+    EfErrCode result = EF_NO_ERR;
+    /* change the current sector status */
+    if (sector->combined != SECTOR_NOT_COMBINED) {
+        /* the combined sector only has one ENV, so it's full after the ENV is written */
+        result = write_status(sector->addr, status_table, SECTOR_STORE_STATUS_NUM, SECTOR_STORE_FULL);
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+        update_sector_map_status(sector->addr, SECTOR_STORE_FULL, SECTOR_DIRTY_UNUSED);
+#endif
+
+        if (is_full) {
+            *is_full = true;
+        }
+    } else if (sector->status.store == SECTOR_STORE_EMPTY) {
+        /* change the sector status to using */
+        result = write_status(sector->addr, status_table, SECTOR_STORE_STATUS_NUM, SECTOR_STORE_USING);
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+        update_sector_map_status(sector->addr, SECTOR_STORE_USING, SECTOR_DIRTY_UNUSED);
+#endif
+    } else if (sector->status.store == SECTOR_STORE_USING) {
+        /* check remain size */
+        if (sector->remain < EF_SEC_REMAIN_THRESHOLD || sector->remain - new_env_len < EF_SEC_REMAIN_THRESHOLD) {
+            /* change the sector status to full */
+            result = write_status(sector->addr, status_table, SECTOR_STORE_STATUS_NUM, SECTOR_STORE_FULL);
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+            update_sector_map_status(sector->addr, SECTOR_STORE_FULL, SECTOR_DIRTY_UNUSED);
+#endif
+
+#ifdef EF_ENV_USING_CACHE
+            /* delete the sector cache */
+            update_sector_cache(sector->addr, sector->addr + SECTOR_SIZE);
+#endif /* EF_ENV_USING_CACHE */
+
+            if (is_full) {
+                *is_full = true;
+            }
+        } else if (is_full) {
+            *is_full = false;
+        }
+    }
+
+    return result;
+}
+
+static void sector_iterator(sector_meta_data_t sector, sector_store_status_t status, void *arg1, void *arg2,
+        bool (*callback)(sector_meta_data_t sector, void *arg1, void *arg2), bool traversal_env) {
+    uint32_t sec_addr;
+
+    /* search all sectors */
+    sector->addr = FAILED_ADDR;
+    while ((sec_addr = get_next_sector_addr(sector)) != FAILED_ADDR) {
+        read_sector_meta_data(sec_addr, sector, false);
+        if (status == SECTOR_STORE_UNUSED || status == sector->status.store) {
+            if (traversal_env) {
+                read_sector_meta_data(sec_addr, sector, traversal_env);
+            }
+            /* iterator is interrupted when callback return true */
+            if (callback && callback(sector, arg1, arg2)) {
+                return;
+            }
+        }
+    }
+}
+
+static bool sector_statistics_cb(sector_meta_data_t sector, void *arg1, void *arg2)
+{
+    size_t *empty_sector = arg1, *using_sector = arg2;
+
+    if (sector->check_ok && sector->status.store == SECTOR_STORE_EMPTY) {
+        (*empty_sector)++;
+    } else if (sector->check_ok && sector->status.store == SECTOR_STORE_USING) {
+        (*using_sector)++;
+    }
+
+    return false;
+}
+
+static bool alloc_env_cb(sector_meta_data_t sector, void *arg1, void *arg2)
+{
+    size_t *env_size = arg1;
+    uint32_t *empty_env = arg2;
+
+#ifdef EF_ENV_USING_HOT_COLD
+    /* the open sector maybe has been collected by GC, so the empty sector is NOT skipped */
+    if (sector->addr == alloc_skip_sec && sector->status.store == SECTOR_STORE_USING) {
+        return false;
+    }
+#endif
+
+    /* 1. sector has space
+     * 2. the NO dirty sector
+     * 3. the dirty sector only when the gc_request is false
+     * 4. the combined sector is only for the big ENV */
+    if (sector->check_ok && sector->remain > *env_size && sector->combined == SECTOR_NOT_COMBINED
+            && ((sector->status.dirty == SECTOR_DIRTY_FALSE)
+                    || (sector->status.dirty == SECTOR_DIRTY_TRUE && !gc_request))) {
+        *empty_env = sector->empty_env;
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * Find the least worn (it has the minimum erase count) sector.
+ */
+static bool least_worn_sec_cb(sector_meta_data_t sector, void *arg1, void *arg2)
+{
+    uint32_t *sec_addr = arg1, *erase_count = arg2;
+
+    if (sector->check_ok && sector->status.dirty == SECTOR_DIRTY_FALSE && sector->combined == SECTOR_NOT_COMBINED
+            && (*sec_addr == FAILED_ADDR || sector->erase_count < *erase_count)) {
+        *sec_addr = sector->addr;
+        *erase_count = sector->erase_count;
+    }
+
+    return false;
+}
+
+/*
+ * Alloc an ENV space. The hot ENV and cold ENV (it's also the GC moved ENV) will be allocated on the different
+ * open sector when EF_ENV_USING_HOT_COLD is enabled, so the GC will NOT copy the cold ENV with hot ENV frequently.
+ */
+static uint32_t alloc_env(sector_meta_data_t sector, size_t env_size, bool hot)
+{
+    uint32_t empty_env = FAILED_ADDR;
+    size_t empty_sector = 0, using_sector = 0;
+
+#ifdef EF_ENV_USING_HOT_COLD
+    uint32_t *open_sec = &env_stream_sec[hot ? ENV_STREAM_HOT : ENV_STREAM_COLD];
+
+    /* alloc the ENV from the open sector of current stream first */
+    if (*open_sec != FAILED_ADDR) {
+        read_sector_meta_data(*open_sec, sector, true);
+        if (sector->status.store == SECTOR_STORE_USING && alloc_env_cb(sector, &env_size, &empty_env)) {
+            return empty_env;
+        }
+    }
+    /* the open sector of other stream will be used only when there is no other space */
+    alloc_skip_sec = env_stream_sec[hot ? ENV_STREAM_COLD : ENV_STREAM_HOT];
+#endif /* EF_ENV_USING_HOT_COLD */
+
+    /* sector status statistics */
+    sector_iterator(sector, SECTOR_STORE_UNUSED, &empty_sector, &using_sector, sector_statistics_cb, false);
+    if (using_sector > 0) {
+        /* alloc the ENV from the using status sector first */
+        sector_iterator(sector, SECTOR_STORE_USING, &env_size, &empty_env, alloc_env_cb, true);
+    }
+    if (empty_sector > 0 && empty_env == FAILED_ADDR) {
+        if (empty_sector > EF_GC_EMPTY_SEC_THRESHOLD || gc_request) {
+            uint32_t sec_addr = FAILED_ADDR, erase_count = 0;
+            /* alloc the ENV from the least worn empty sector, so all sectors will be erased evenly */
+            sector_iterator(sector, SECTOR_STORE_EMPTY, &sec_addr, &erase_count, least_worn_sec_cb, false);
+            if (sec_addr != FAILED_ADDR) {
+                read_sector_meta_data(sec_addr, sector, true);
+                alloc_env_cb(sector, &env_size, &empty_env);
+            }
+            if (empty_env == FAILED_ADDR) {
+                sector_iterator(sector, SECTOR_STORE_EMPTY, &env_size, &empty_env, alloc_env_cb, true);
+            }
+        }
+    }
+
+#ifdef EF_ENV_USING_HOT_COLD
+    if (empty_env == FAILED_ADDR && using_sector > 0 && alloc_skip_sec != FAILED_ADDR) {
+        /* share the open sector with other stream before GC */
+        alloc_skip_sec = FAILED_ADDR;
+        sector_iterator(sector, SECTOR_STORE_USING, &env_size, &empty_env, alloc_env_cb, true);
+    }
+    alloc_skip_sec = FAILED_ADDR;
+    if (empty_env != FAILED_ADDR) {
+        *open_sec = sector->addr;
+    }
+#endif /* EF_ENV_USING_HOT_COLD */
+
+    if (empty_env == FAILED_ADDR && empty_sector > 0 && empty_sector <= EF_GC_EMPTY_SEC_THRESHOLD && !gc_request) {
+        /* no space for new ENV now will GC and retry */
+        EF_DEBUG("Trigger a GC check after alloc ENV failed.\n");
+        gc_request = true;
+    }
+
+    return empty_env;
+}
+
+/*
+ * Find the continuous empty sectors for the combined sector.
+ */
+static bool combined_sec_cb(sector_meta_data_t sector, void *arg1, void *arg2)
+{
+    uint32_t *sec_num = arg1, *empty_sec = arg2;
+
+    /* empty_sec[0]: the first empty sector address, empty_sec[1]: the continuous empty sector number */
+    if (sector->check_ok && sector->status.store == SECTOR_STORE_EMPTY && sector->combined == SECTOR_NOT_COMBINED) {
+        if (empty_sec[1] == 0 || empty_sec[0] + empty_sec[1] * SECTOR_SIZE != sector->addr) {
+            empty_sec[0] = sector->addr;
+            empty_sec[1] = 1;
+        } else {
+            empty_sec[1]++;
+        }
+        return empty_sec[1] >= *sec_num;
+    }
+    empty_sec[1] = 0;
+
+    return false;
+}
+
+/*
+ * Get the sector number of the combined sector for the big ENV, the erase count table is on the end.
+ */
+static uint32_t get_combined_sec_num(size_t env_size)
+{
+    uint32_t sec_num = (SECTOR_HDR_DATA_SIZE + env_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+
+    if (SECTOR_HDR_DATA_SIZE + env_size + SECTOR_COMBINED_TABLE_SIZE(sec_num) > sec_num * SECTOR_SIZE) {
+        sec_num++;
+    }
+
+    return sec_num;
+}
+
+/*
+ * Alloc the combined sector for the big ENV which is larger than sector. The continuous empty sectors will be
+ * combined to one sector, and the empty sector reserve for GC is kept.
+ */
+static uint32_t alloc_combined_env(sector_meta_data_t sector, size_t env_size)
+{
+    uint32_t sec_num = get_combined_sec_num(env_size), empty_sec[2] = { 0, 0 }, table_addr, i;
+    uint32_t erase_count[EF_WG_ALIGN(sizeof(uint32_t)) / sizeof(uint32_t)];
+    size_t empty_sector = 0, using_sector = 0;
+
+    sector_iterator(sector, SECTOR_STORE_UNUSED, &empty_sector, &using_sector, sector_statistics_cb, false);
+    if (empty_sector < sec_num + EF_GC_EMPTY_SEC_THRESHOLD) {
+        return FAILED_ADDR;
+    }
+    sector_iterator(sector, SECTOR_STORE_EMPTY, &sec_num, empty_sec, combined_sec_cb, false);
+    if (empty_sec[1] < sec_num) {
+        EF_INFO("Warning: There is no %d continuous empty sectors for the ENV (size %d).\n", sec_num, env_size);
+        return FAILED_ADDR;
+    }
+    /* combine the sectors, the header of other sectors will be erased for the ENV data */
+    if (flash_write(empty_sec[0] + SECTOR_COMBINED_OFFSET, &sec_num, sizeof(uint32_t)) != EF_NO_ERR) {
+        return FAILED_ADDR;
+    }
+    /* the erase count of other sectors is saved to the table on the end, so the last sector is erased first */
+    table_addr = empty_sec[0] + sec_num * SECTOR_SIZE - SECTOR_COMBINED_TABLE_SIZE(sec_num);
+    memset(erase_count, 0xFF, sizeof(erase_count));
+    for (i = sec_num - 1; i > 0; i--) {
+        read_sector_meta_data(empty_sec[0] + i * SECTOR_SIZE, sector, false);
+        erase_count[0] = sector->erase_count < 0xFFFFFFFE ? sector->erase_count + 1 : 0xFFFFFFFE;
+        if (flash_erase(empty_sec[0] + i * SECTOR_SIZE, SECTOR_SIZE) != EF_NO_ERR
+                || flash_write(table_addr + (i - 1) * sizeof(erase_count), erase_count, sizeof(erase_count))
+                        != EF_NO_ERR) {
+            return FAILED_ADDR;
+        }
+    }
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+    reload_sector_map(empty_sec[0]);
+#endif
+
+    read_sector_meta_data(empty_sec[0], sector, false);
+    sector->empty_env = sector->addr + SECTOR_HDR_DATA_SIZE;
+    sector->remain = get_sector_size(sector) - SECTOR_HDR_DATA_SIZE - SECTOR_COMBINED_TABLE_SIZE(sec_num);
+
+    return sector->empty_env;
+}
+
+static void wear_stats_add(env_wear_stats_t stats, uint64_t *total, uint32_t erase_count)
+{
+    if (stats->sectors == 0 || erase_count < stats->min) {
+        stats->min = erase_count;
+    }
+    if (erase_count > stats->max) {
+        stats->max = erase_count;
+    }
+    *total += erase_count;
+    stats->sectors++;
+}
+
+/**
+ * Get the erase count statistics of all ENV sectors. It can be used to forecast the flash lifetime.
+ *
+ * @param stats the statistics
+ */
+void ef_get_env_wear_stats(env_wear_stats_t stats)
+{
+    struct sector_meta_data sector;
+    uint64_t total = 0;
+    uint32_t addr, i;
+
+    EF_ASSERT(stats);
+
+    memset(stats, 0x00, sizeof(struct env_wear_stats));
+
+    if (!init_ok) {
+        EF_INFO("ENV isn't initialize OK.\n");
+        return;
+    }
+
+    /* lock the ENV cache */
+    ef_port_env_lock();
+
+    /* iterate by the physical sector, so the other sectors of combined sector are counted too */
+    for (addr = env_start_addr; addr < env_start_addr + ENV_AREA_SIZE; addr += SECTOR_SIZE) {
+        read_sector_meta_data(addr, &sector, false);
+        wear_stats_add(stats, &total, sector.erase_count);
+        /* the other combined sectors header has been erased, their erase count is on the table */
+        for (i = 1; sector.combined != SECTOR_NOT_COMBINED && i < sector.combined; i++) {
+            wear_stats_add(stats, &total, read_combined_erase_count(&sector, i));
+            addr += SECTOR_SIZE;
+        }
+    }
+    if (stats->sectors > 0) {
+        stats->mean = (uint32_t) (total / stats->sectors);
+    }
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
+}
+
+static EfErrCode del_env(const char *key, env_node_obj_t old_env, bool complete_del) {
+    EfErrCode result = EF_NO_ERR;
+    uint32_t dirty_status_addr;
+    struct env_node_obj env;
+    static bool last_is_complete_del = false;
+
+#if (ENV_STATUS_TABLE_SIZE >= DIRTY_STATUS_TABLE_SIZE)
+    uint8_t status_table[ENV_STATUS_TABLE_SIZE];
+#else
+    uint8_t status_table[DIRTY_STATUS_TABLE_SIZE];
+#endif
+
+    /* need find ENV */
+    if (!old_env) {
+        /* find ENV */
+        if (find_env(key, &env)) {
+            old_env = &env;
+        } else {
+            EF_DEBUG("Not found '%s' in ENV.\n", key);
+            return EF_ENV_NAME_ERR;
+        }
+    }
+    /* change and save the new status */
+    if (!complete_del) {
+        result = write_status(old_env->addr.start, status_table, ENV_STATUS_NUM, ENV_PRE_DELETE);
+        last_is_complete_del = true;
+
+#ifdef EF_ENV_USING_CACHE
+        /* the cached ENV status is NOT ENV_WRITE now */
+        unverify_env_cache(old_env->addr.start, 1);
+#endif
+    } else {
+        result = write_status(old_env->addr.start, status_table, ENV_STATUS_NUM, ENV_DELETED);
+
+        if (!last_is_complete_del && result == EF_NO_ERR) {
+#ifdef EF_ENV_USING_CACHE
+            /* delete the ENV in flash and cache */
+            if (key != NULL) {
+                /* when using del_env(key, NULL, true) or del_env(key, env, true) in ef_del_env() and set_env() */
+                update_env_cache(key, strlen(key), FAILED_ADDR);
+            } else if (old_env != NULL) {
+                /* when using del_env(NULL, env, true) in move_env() */
+                update_env_cache(old_env->name, old_env->name_len, FAILED_ADDR);
+            }
+#endif /* EF_ENV_USING_CACHE */
+
+#ifdef EF_ENV_USING_BLOOM
+            /* the ENV is removed by ef_del_env() or set_env(), it will be a stale ENV in filter */
+            if (key != NULL && env_bloom_ok) {
+                if (++env_bloom_stat.stale * 2 > env_bloom_stat.keys) {
+                    env_bloom_rebuild();
+                }
+            }
+#endif /* EF_ENV_USING_BLOOM */
+        }
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+        if (result == EF_NO_ERR) {
+            free_sector_map_env(old_env->addr.start, old_env->len);
+        } else {
+            reload_sector_map(old_env->addr.start);
+        }
+#endif
+
+#ifdef EF_ENV_USING_INDEX
+        if (result == EF_NO_ERR) {
+            if (key != NULL) {
+                delete_env_index(key, strlen(key), old_env->addr.start);
+            } else {
+                delete_env_index(old_env->name, old_env->name_len, old_env->addr.start);
+            }
+        }
+#endif /* EF_ENV_USING_INDEX */
+
+        last_is_complete_del = false;
+    }
+
+    dirty_status_addr = EF_ALIGN_DOWN(old_env->addr.start, SECTOR_SIZE) + SECTOR_DIRTY_OFFSET;
+    /* read and change the sector dirty status */
+    if (result == EF_NO_ERR
+            && read_status(dirty_status_addr, status_table, SECTOR_DIRTY_STATUS_NUM) == SECTOR_DIRTY_FALSE) {
+        result = write_status(dirty_status_addr, status_table, SECTOR_DIRTY_STATUS_NUM, SECTOR_DIRTY_TRUE);
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+        update_sector_map_status(dirty_status_addr, SECTOR_STORE_UNUSED, SECTOR_DIRTY_TRUE);
+#endif
+    }
+
+    return result;
+}
+
+/*
+ * move the ENV to new space
+ *
+ * The dst is the destination sector cursor. The ENV will be written to the cursor's empty ENV address sequentially,
+ * and a new destination sector will be allocated only when the cursor is invalid (empty_env is FAILED_ADDR) or full.
+ */
+static EfErrCode move_env(env_node_obj_t env, sector_meta_data_t dst)
+{
+    EfErrCode result = EF_NO_ERR;
+    uint8_t status_table[ENV_STATUS_TABLE_SIZE];
+    uint32_t env_addr;
+    bool is_full = false;
+
+    /* prepare to delete the current ENV */
+    if (env->status == ENV_WRITE) {
+        del_env(NULL, env, false);
+    }
+
+    if (in_recovery_check) {
+        struct env_node_obj env_bak;
+        char name[EF_ENV_NAME_MAX + 1] = { 0 };
+        strncpy(name, env->name, env->name_len);
+        /* check the ENV in flash is already create success */
+        if (find_env_no_cache(name, &env_bak)) {
+            /* already create success, don't need to duplicate */
+            result = EF_NO_ERR;
+            goto __exit;
+        }
+    }
+
+    if (env->len > SECTOR_SIZE - SECTOR_HDR_DATA_SIZE) {
+        /* the big ENV will be moved to a new combined sector */
+        dst->empty_env = alloc_combined_env(dst, env->len);
+    } else if (dst->empty_env == FAILED_ADDR || dst->remain <= env->len) {
+        /* the destination sector has not enough space, alloc a new one */
+        dst->empty_env = alloc_env(dst, env->len, false);
+    }
+
+    if ((env_addr = dst->empty_env) == FAILED_ADDR) {
+        return EF_ENV_FULL;
+    }
+    /* start move the ENV */
+    {
+        uint8_t buf[EF_GC_COPY_BUF_SIZE];
+        size_t len, size, env_len = env->len;
+
+        /* update the new ENV sector status first */
+        update_sec_status(dst, env->len, &is_full);
+        dst->status.store = is_full ? SECTOR_STORE_FULL : SECTOR_STORE_USING;
+
+        write_status(env_addr, status_table, ENV_STATUS_NUM, ENV_PRE_WRITE);
+        env_len -= ENV_MAGIC_OFFSET;
+        for (len = 0, size = 0; len < env_len; len += size) {
+            if (len + sizeof(buf) < env_len) {
+                size = sizeof(buf);
+            } else {
+                size = env_len - len;
+            }
+            flash_read(env->addr.start + ENV_MAGIC_OFFSET + len, (uint32_t *) buf, EF_WG_ALIGN(size));
+            result = flash_write(env_addr + ENV_MAGIC_OFFSET + len, (uint32_t *) buf, size);
+            if (result != EF_NO_ERR) {
+                break;
+            }
+        }
+        if (result == EF_NO_ERR) {
+            result = write_status(env_addr, status_table, ENV_STATUS_NUM, ENV_WRITE);
+        }
+        /* move the cursor to next empty ENV, a full or write failed sector will NOT be used again */
+        if (result == EF_NO_ERR && !is_full) {
+            dst->empty_env += env->len;
+            dst->remain -= env->len;
+        } else {
+            dst->empty_env = FAILED_ADDR;
+        }
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+        if (result == EF_NO_ERR) {
+            alloc_sector_map_env(env_addr, env->len);
+        } else {
+            reload_sector_map(env_addr);
+        }
+#endif
+
+#ifdef EF_ENV_USING_CACHE
+        if (!is_full) {
+            update_sector_cache(EF_ALIGN_DOWN(env_addr, SECTOR_SIZE), env_addr + env->len);
+        }
+        update_env_cache(env->name, env->name_len, env_addr);
+#endif /* EF_ENV_USING_CACHE */
+
+#ifdef EF_ENV_USING_INDEX
+        update_env_index(env->name, env->name_len, env_addr);
+#endif
+
+#ifdef EF_ENV_USING_BLOOM
+        env_bloom_add(env->name, env->name_len);
+#endif
+    }
+
+    EF_DEBUG("Moved the ENV (%.*s) from 0x%08X to 0x%08X.\n", env->name_len, env->name, env->addr.start, env_addr);
+
+__exit:
+    del_env(NULL, env, true);
+
+    return result;
+}
+
+static uint32_t new_env(sector_meta_data_t sector, size_t env_size, bool hot)
+{
+    bool already_gc = false;
+    uint32_t empty_env = FAILED_ADDR;
+
+    if (env_size > SECTOR_SIZE - SECTOR_HDR_DATA_SIZE) {
+        /* the big ENV needs more empty sectors, so collect the dirty sectors until the empty sectors is enough */
+        if ((empty_env = alloc_combined_env(sector, env_size)) == FAILED_ADDR) {
+            EF_DEBUG("Warning: Alloc a big ENV (size %d) failed when new ENV. Now will GC then retry.\n", env_size);
+            /* the GC moved ENV can use the reserved empty sector, and will NOT be moved to the dirty sector */
+            gc_request = true;
+            gc_collect_by_empty_sec(get_combined_sec_num(env_size) + EF_GC_EMPTY_SEC_THRESHOLD - 1);
+            empty_env = alloc_combined_env(sector, env_size);
+        }
+        return empty_env;
+    }
+
+__retry:
+
+    if ((empty_env = alloc_env(sector, env_size, hot)) == FAILED_ADDR && gc_request && !already_gc) {
+        EF_DEBUG("Warning: Alloc an ENV (size %d) failed when new ENV. Now will GC then retry.\n", env_size);
+        gc_collect();
+        already_gc = true;
+        goto __retry;
+    }
+
+    return empty_env;
+}
+
+static uint32_t new_env_by_kv(sector_meta_data_t sector, size_t key_len, size_t buf_len, bool hot)
+{
+    size_t env_len = ENV_HDR_DATA_SIZE + EF_WG_ALIGN(key_len) + EF_WG_ALIGN(buf_len);
+
+    return new_env(sector, env_len, hot);
+}
+
+static bool gc_check_cb(sector_meta_data_t sector, void *arg1, void *arg2)
+{
+    size_t *empty_sec = arg1;
+
+    if (sector->check_ok) {
+        *empty_sec = *empty_sec + 1;
+    }
+
+    return false;
+
+}
+
+/*
+ * Check the ENV on combined sector is live. The big ENV is NOT moved by GC,
+ * so the combined sector will be collected after its ENV is deleted.
+ */
+static bool combined_sector_is_live(sector_meta_data_t sector, bool check_crc)
+{
+    struct env_node_obj env;
+    uint8_t status_table[ENV_STATUS_TABLE_SIZE];
+
+    if (sector->combined == SECTOR_NOT_COMBINED) {
+        return false;
+    }
+    env.addr.start = sector->addr + SECTOR_HDR_DATA_SIZE;
+    if (check_crc) {
+        read_env(&env);
+        if (!env.crc_is_ok) {
+            return false;
+        }
+    } else {
+        env.status = (env_status_t) read_status(env.addr.start, status_table, ENV_STATUS_NUM);
+    }
+
+    return env.status == ENV_WRITE || env.status == ENV_PRE_DELETE;
+}
+
+static bool do_gc(sector_meta_data_t sector, void *arg1, void *arg2)
+{
+    struct env_node_obj env;
+    sector_meta_data_t dst = arg1;
+
+    /* the pinned sector will be collected after it's unpinned */
+    if (sector_is_pinned(sector->addr) || combined_sector_is_live(sector, false)) {
+        return false;
+    }
+
+    if (sector->check_ok && (sector->status.dirty == SECTOR_DIRTY_TRUE || sector->status.dirty == SECTOR_DIRTY_GC)) {
+        uint8_t status_table[DIRTY_STATUS_TABLE_SIZE];
+        /* change the sector status to GC */
+        write_status(sector->addr + SECTOR_DIRTY_OFFSET, status_table, SECTOR_DIRTY_STATUS_NUM, SECTOR_DIRTY_GC);
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+        update_sector_map_status(sector->addr, SECTOR_STORE_UNUSED, SECTOR_DIRTY_GC);
+#endif
+        /* search all ENV */
+        env.addr.start = FAILED_ADDR;
+        while ((env.addr.start = get_next_env_addr(sector, &env)) != FAILED_ADDR) {
+            read_env(&env);
+            if (env.crc_is_ok && (env.status == ENV_WRITE || env.status == ENV_PRE_DELETE)) {
+                /* move the ENV to new space */
+                if (move_env(&env, dst) != EF_NO_ERR) {
+                    EF_DEBUG("Error: Moved the ENV (%.*s) for GC failed.\n", env.name_len, env.name);
+                }
+            }
+        }
+        format_combined_sector(sector);
+        EF_DEBUG("Collect a sector @0x%08X\n", sector->addr);
+    }
+
+    return false;
+}
+
+#if (EF_GC_POLICY != EF_GC_POLICY_ALL)
+/*
+ * Get the GC score of the dirty sector, the sector which has the highest score will be collected first.
+ */
+static uint32_t gc_sector_score(sector_meta_data_t sector)
+{
+    size_t live, used, dead;
+    uint32_t score;
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+    sector_map_node_t node = get_sector_map_node(sector->addr);
+
+    if (node != NULL) {
+        live = node->live;
+        used = node->empty_env - sector->addr - SECTOR_HDR_DATA_SIZE;
+    } else
+#endif /* EF_ENV_USING_SECTOR_MAP */
+    {
+        calc_sector_usage(sector, &live, &used);
+    }
+
+    dead = used > live ? used - live : 0;
+    /* the reclaimed bytes per copied byte, enlarged by 256 */
+    score = (uint32_t) ((dead << 8) / (live + 1));
+
+#if (EF_GC_POLICY == EF_GC_POLICY_COST_BENEFIT)
+    /* the cold sector (NOT written for a long time) is preferred, its live ENV maybe NOT deleted soon */
+    if (node != NULL) {
+        uint32_t age = sector_map_full_seq - node->write_seq;
+
+        score *= 1 + (age < EF_GC_AGE_MAX ? age : EF_GC_AGE_MAX);
+    }
+#endif /* EF_GC_POLICY == EF_GC_POLICY_COST_BENEFIT */
+
+    return score;
+}
+#endif /* EF_GC_POLICY != EF_GC_POLICY_ALL */
+
+static bool gc_select_cb(sector_meta_data_t sector, void *arg1, void *arg2)
+{
+    uint32_t *victim_addr = arg1, *victim_score = arg2, score;
+
+    if (sector_is_pinned(sector->addr) || combined_sector_is_live(sector, false)) {
+        return false;
+    }
+
+    if (sector->check_ok && (sector->status.dirty == SECTOR_DIRTY_TRUE || sector->status.dirty == SECTOR_DIRTY_GC)) {
+        if (sector->status.dirty == SECTOR_DIRTY_GC) {
+            /* the collecting sector must be finished first */
+            score = 0xFFFFFFFF;
+        } else {
+#if (EF_GC_POLICY == EF_GC_POLICY_ALL)
+            /* the first dirty sector by address order */
+            score = 1;
+#else
+            score = gc_sector_score(sector);
+#endif
+        }
+        /* the sector which has NOT dead bytes also can be collected when there is no better one */
+        if (*victim_addr == FAILED_ADDR || score > *victim_score) {
+            *victim_addr = sector->addr;
+            *victim_score = score;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Select the victim sector for GC by EF_GC_POLICY. It's return FAILED_ADDR when no sector can be collected.
+ */
+static uint32_t gc_select_victim(void)
+{
+    struct sector_meta_data sector;
+    uint32_t victim_addr = FAILED_ADDR, victim_score = 0;
+
+    sector_iterator(&sector, SECTOR_STORE_UNUSED, &victim_addr, &victim_score, gc_select_cb, false);
+
+    return victim_addr;
+}
+
+/*
+ * Collect the dirty sectors when the empty sector number is less than or equal to the threshold.
+ */
+static void gc_collect_by_empty_sec(size_t threshold)
+{
+    struct sector_meta_data sector, dst;
+    size_t empty_sec = 0;
+
+    /* GC check the empty sector number */
+    sector_iterator(&sector, SECTOR_STORE_EMPTY, &empty_sec, NULL, gc_check_cb, false);
+
+    /* do GC collect */
+    EF_DEBUG("The remain empty sector is %d, GC threshold is %d.\n", empty_sec, threshold);
+    if (empty_sec <= threshold) {
+        /* the collecting sector of incremental GC step will be collected too */
+        gc_step_addr = FAILED_ADDR;
+        /* all live ENV will be moved to the destination sector sequentially */
+        dst.empty_env = FAILED_ADDR;
+#if (EF_GC_POLICY == EF_GC_POLICY_ALL)
+        sector_iterator(&sector, SECTOR_STORE_UNUSED, &dst, NULL, do_gc, false);
+#else
+        {
+            uint32_t victim_addr;
+            size_t collected_sec = 0;
+
+            /* collect the best victim sector one by one until the empty sector reserve has been restored,
+             * the loop times is limited by sector number, because the flash maybe can NOT be erased */
+            while (empty_sec <= threshold && collected_sec++ < SECTOR_NUM
+                    && (victim_addr = gc_select_victim()) != FAILED_ADDR) {
+                read_sector_meta_data(victim_addr, &sector, false);
+                do_gc(&sector, &dst, NULL);
+                empty_sec = 0;
+                sector_iterator(&sector, SECTOR_STORE_EMPTY, &empty_sec, NULL, gc_check_cb, false);
+            }
+        }
+#endif /* EF_GC_POLICY == EF_GC_POLICY_ALL */
+    }
+
+    gc_request = false;
+}
+
+/*
+ * The GC will be triggered on the following scene:
+ * 1. alloc an ENV when the flash not has enough space
+ * 2. write an ENV then the flash not has enough space
+ */
+static void gc_collect(void)
+{
+    gc_collect_by_empty_sec(EF_GC_EMPTY_SEC_THRESHOLD);
+}
+
+/*
+ * Select the next sector for incremental GC step. It's return FAILED_ADDR when GC is not needed.
+ */
+static uint32_t gc_step_select(void)
+{
+    struct sector_meta_data sector;
+    size_t empty_sec = 0;
+
+    sector_iterator(&sector, SECTOR_STORE_EMPTY, &empty_sec, NULL, gc_check_cb, false);
+    if (empty_sec <= EF_GC_STEP_EMPTY_SEC_THRESHOLD) {
+        return gc_select_victim();
+    }
+
+    return FAILED_ADDR;
+}
+
+/*
+ * Do a slice of GC. It will move the live ENV on the collecting sector until max_bytes has been moved,
+ * or format the collecting sector when all live ENV has been moved.
+ *
+ * @return true: there has more GC work
+ */
+static bool gc_step(size_t max_bytes)
+{
+    struct sector_meta_data sector, dst;
+    size_t moved_bytes = 0;
+    bool gc_request_bak = gc_request, use_reserved = false;
+
+    if (gc_step_addr != FAILED_ADDR) {
+        /* the collecting sector maybe collected by gc_collect() */
+        read_sector_meta_data(gc_step_addr, &sector, false);
+        if (!sector.check_ok || sector.status.dirty != SECTOR_DIRTY_GC) {
+            gc_step_addr = FAILED_ADDR;
+        }
+    }
+
+    if (gc_step_addr != FAILED_ADDR && sector_is_pinned(gc_step_addr)) {
+        /* continue after the collecting sector is unpinned */
+        return false;
+    }
+
+    if (gc_step_addr == FAILED_ADDR) {
+        uint8_t status_table[DIRTY_STATUS_TABLE_SIZE];
+
+        if ((gc_step_addr = gc_step_select()) == FAILED_ADDR) {
+            return false;
+        }
+        read_sector_meta_data(gc_step_addr, &sector, false);
+        /* change the sector status to GC */
+        write_status(sector.addr + SECTOR_DIRTY_OFFSET, status_table, SECTOR_DIRTY_STATUS_NUM, SECTOR_DIRTY_GC);
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+        update_sector_map_status(sector.addr, SECTOR_STORE_UNUSED, SECTOR_DIRTY_GC);
+#endif
+        gc_step_env.addr.start = FAILED_ADDR;
+        gc_step_moved = false;
+    }
+
+    if (!gc_step_moved) {
+        dst.empty_env = FAILED_ADDR;
+        while ((gc_step_env.addr.start = get_next_env_addr(&sector, &gc_step_env)) != FAILED_ADDR) {
+            read_env(&gc_step_env);
+            if (gc_step_env.crc_is_ok && (gc_step_env.status == ENV_WRITE || gc_step_env.status == ENV_PRE_DELETE)) {
+                /* only one sector is collecting, so the dirty sector can be used for moved ENV first */
+                if (dst.empty_env == FAILED_ADDR || dst.remain <= gc_step_env.len) {
+                    gc_request = false;
+                    if ((dst.empty_env = alloc_env(&dst, gc_step_env.len, false)) == FAILED_ADDR) {
+                        /* use the reserved empty sector as same as gc_collect(), the collecting sector will be
+                         * finished on this step, so the reserved empty sector is restored before the ENV set */
+                        gc_request = true;
+                        dst.empty_env = alloc_env(&dst, gc_step_env.len, false);
+                        use_reserved = true;
+                    }
+                    gc_request = gc_request_bak;
+                }
+                /* move the ENV to new space */
+                if (dst.empty_env == FAILED_ADDR || move_env(&gc_step_env, &dst) != EF_NO_ERR) {
+                    EF_INFO("Error: Moved the ENV (%.*s) for GC failed.\n", gc_step_env.name_len, gc_step_env.name);
+                    /* keep the collecting sector, it will be collected on next step or gc_collect() */
+                    gc_step_env.addr.start = FAILED_ADDR;
+                    return false;
+                }
+                moved_bytes += gc_step_env.len;
+                if (moved_bytes >= max_bytes && !use_reserved) {
+                    break;
+                }
+            }
+        }
+        if (gc_step_env.addr.start != FAILED_ADDR) {
+            /* the max bytes has been moved, continue on next step */
+            return true;
+        }
+        gc_step_moved = true;
+        if (moved_bytes > 0 && !use_reserved) {
+            /* format the sector on next step */
+            return true;
+        }
+    }
+
+    format_combined_sector(&sector);
+    EF_DEBUG("Collect a sector @0x%08X\n", gc_step_addr);
+    gc_step_addr = FAILED_ADDR;
+
+    return gc_step_select() != FAILED_ADDR;
+}
+
+/**
+ * Do a slice of GC, it's recommended to call it on an idle task.
+ * Every step will move the live ENV until max_bytes has been moved (at least one ENV), or format one sector.
+ * The GC will be started when the empty sector number is less than or equal to EF_GC_STEP_EMPTY_SEC_THRESHOLD,
+ * so the ENV set will NOT do the blocking GC if the GC step is called in time.
+ *
+ * @param max_bytes the max ENV bytes which will be moved on this step
+ *
+ * @return true: there has more GC work, false: GC is not needed now
+ */
+bool ef_env_gc_step(size_t max_bytes)
+{
+    bool more_work;
+
+    if (!init_ok) {
+        EF_INFO("ENV isn't initialize OK.\n");
+        return false;
+    }
+
+    /* lock the ENV cache */
+    ef_port_env_lock();
+
+    more_work = gc_step(max_bytes);
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
+
+    return more_work;
+}
+
+/**
+ * Set the update frequency hint of ENV. The hot ENV will be written to the separate sector with the cold ENV.
+ * The hint is saved on RAM, so it should be set again after every reboot.
+ *
+ * @param key ENV name
+ * @param hint EF_ENV_HINT_AUTO: it's judged by the observed update frequency
+ *
+ * @return result, EF_ENV_FULL: the hot table is full of hinted ENV
+ */
+EfErrCode ef_set_env_hint(const char *key, EfEnvHint hint)
+{
+    EfErrCode result = EF_NO_ERR;
+
+#ifdef EF_ENV_USING_HOT_COLD
+    env_hot_node_t node;
+
+    if (!init_ok) {
+        EF_INFO("ENV isn't initialize OK.\n");
+        return EF_ENV_INIT_FAILED;
+    }
+
+    /* lock the ENV cache */
+    ef_port_env_lock();
+
+    if ((node = env_hot_lookup(key, strlen(key), true)) != NULL) {
+        node->hint = hint;
+    } else {
+        result = EF_ENV_FULL;
+    }
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
+#endif /* EF_ENV_USING_HOT_COLD */
+
+    return result;
+}
+
+static EfErrCode align_write(uint32_t addr, const uint32_t *buf, size_t size)
+{
+    EfErrCode result = EF_NO_ERR;
+    size_t align_remain;
+
+#if (EF_WRITE_GRAN / 8 > 0)
+    uint8_t align_data[EF_WRITE_GRAN / 8];
+    size_t align_data_size = sizeof(align_data);
+#else
+    /* For compatibility with C89 */
+    uint8_t align_data_u8, *align_data = &align_data_u8;
+    size_t align_data_size = 1;
+#endif
+
+    memset(align_data, 0xFF, align_data_size);
+    align_remain = EF_WG_ALIGN_DOWN(size);//use align_remain temporary to save aligned size.
+
+    if(align_remain > 0){//it may be 0 in this function.
+        result = flash_write(addr, buf, align_remain);
+    }
+
+    align_remain = size - align_remain;
+    if (result == EF_NO_ERR && align_remain) {
+        memcpy(align_data, (uint8_t *)buf + EF_WG_ALIGN_DOWN(size), align_remain);
+        result = flash_write(addr + EF_WG_ALIGN_DOWN(size), (uint32_t *) align_data, align_data_size);
+    }
+
+    return result;
+}
+
+/*
+ * The data writer merges the small data on the staging buffer, then writes it by page.
+ * The data will NOT be written when the writer address is FAILED_ADDR, only the length and CRC32 are calculated.
+ */
+struct data_writer {
+    uint32_t addr;                               /**< the data start address, FAILED_ADDR: only calculate the length */
+    uint32_t crc32;                              /**< the CRC32 value of written data */
+    size_t len;                                  /**< the written length */
+    size_t max_len;                              /**< stop compress when the written length is more than it */
+    size_t buf_len;                              /**< the data length on buffer */
+    uint8_t buf[EF_ENV_WRITE_BUF_SIZE];          /**< the staging buffer, it's aligned by write granularity */
+    EfErrCode result;                            /**< the write result */
+};
+
+static void init_data_writer(struct data_writer *writer, uint32_t addr, uint32_t crc32)
+{
+    writer->addr = addr;
+    writer->crc32 = crc32;
+    writer->len = 0;
+    writer->max_len = ~0UL;
+    writer->buf_len = 0;
+    writer->result = EF_NO_ERR;
+}
+
+static void flush_data_writer(struct data_writer *writer)
+{
+    if (writer->addr == FAILED_ADDR) {
+        writer->crc32 = ef_calc_crc32(writer->crc32, writer->buf, writer->buf_len);
+    } else if (writer->result == EF_NO_ERR && writer->buf_len > 0) {
+        writer->result = align_write(writer->addr + writer->len - writer->buf_len, (uint32_t *) writer->buf,
+                writer->buf_len);
+    }
+    writer->buf_len = 0;
+}
+
+/*
+ * Write the data to the staging buffer. The buffer will be flushed when it's full or reach the page boundary.
+ * The flushed data is always aligned by write granularity, because the page size and buffer size are aligned.
+ */
+static void write_data(struct data_writer *writer, const void *data, size_t len)
+{
+    size_t size, page_remain, direct_size;
+
+    for (; len > 0; len -= size, data = (const uint8_t *) data + size) {
+        size = sizeof(writer->buf) - writer->buf_len;
+        if (writer->addr != FAILED_ADDR) {
+            page_remain = EF_WRITE_PAGE_SIZE - (writer->addr + writer->len) % EF_WRITE_PAGE_SIZE;
+            /* the large data is written directly until the page end when the buffer is empty */
+            direct_size = EF_WG_ALIGN_DOWN(len < page_remain ? len : page_remain);
+            if (writer->buf_len == 0 && direct_size >= sizeof(writer->buf)) {
+                size = direct_size;
+                if (writer->result == EF_NO_ERR) {
+                    writer->result = flash_write(writer->addr + writer->len, data, size);
+                }
+                writer->len += size;
+                continue;
+            }
+            if (size > page_remain) {
+                size = page_remain;
+            }
+        }
+        if (size > len) {
+            size = len;
+        }
+        memcpy(writer->buf + writer->buf_len, data, size);
+        writer->buf_len += size;
+        writer->len += size;
+        if (writer->buf_len == sizeof(writer->buf)
+                || (writer->addr != FAILED_ADDR && (writer->addr + writer->len) % EF_WRITE_PAGE_SIZE == 0)) {
+            flush_data_writer(writer);
+        }
+    }
+}
+
+/*
+ * Write the 0xFF padding data to the staging buffer, the next data will be aligned by write granularity.
+ */
+static void write_data_padding(struct data_writer *writer)
+{
+    uint8_t ff = 0xFF;
+
+    while (writer->len != EF_WG_ALIGN(writer->len)) {
+        write_data(writer, &ff, 1);
+    }
+}
+
+#ifdef EF_ENV_USING_COMPRESS
+static void write_value_byte(struct data_writer *writer, uint8_t data)
+{
+    write_data(writer, &data, 1);
+}
+
+static void write_literal(struct data_writer *writer, const uint8_t *literal, size_t len)
+{
+    size_t run, i;
+
+    for (; len > 0; len -= run, literal += run) {
+        run = len < ENV_COMPRESS_MAX_LITERAL ? len : ENV_COMPRESS_MAX_LITERAL;
+        write_value_byte(writer, run - 1);
+        for (i = 0; i < run; i++) {
+            write_value_byte(writer, literal[i]);
+        }
+    }
+}
+
+/*
+ * Compress the ENV value by the greedy LZ77 with a small hash table, @see read_compressed_value
+ * The compressed data will be appended to the writer, and the writer will NOT be flushed.
+ *
+ * @return the compressed length, it's greater than the writer max length when the value is NOT compressible
+ */
+static size_t compress_value(const uint8_t *value, size_t len, struct data_writer *writer)
+{
+    static uint32_t hash_table[1 << ENV_COMPRESS_HASH_BITS];
+    size_t pos = 0, literal = 0, match_len, i;
+    uint32_t hash, match;
+
+    for (i = 0; i < sizeof(hash_table) / sizeof(hash_table[0]); i++) {
+        hash_table[i] = FAILED_ADDR;
+    }
+
+    while (pos + ENV_COMPRESS_MIN_MATCH <= len && writer->len <= writer->max_len) {
+        hash = (uint32_t)((value[pos] | value[pos + 1] << 8 | (uint32_t) value[pos + 2] << 16) * 2654435761UL);
+        hash >>= 32 - ENV_COMPRESS_HASH_BITS;
+        match = hash_table[hash];
+        hash_table[hash] = pos;
+        if (match != FAILED_ADDR && pos - match <= ENV_COMPRESS_WINDOW
+                && !memcmp(value + match, value + pos, ENV_COMPRESS_MIN_MATCH)) {
+            for (match_len = ENV_COMPRESS_MIN_MATCH; pos + match_len < len && match_len < ENV_COMPRESS_MAX_MATCH
+                    && value[match + match_len] == value[pos + match_len]; match_len++);
+            write_literal(writer, value + pos - literal, literal);
+            write_value_byte(writer, 0x80 | (match_len - ENV_COMPRESS_MIN_MATCH));
+            write_value_byte(writer, pos - match - 1);
+            pos += match_len;
+            literal = 0;
+        } else {
+            pos++;
+            literal++;
+        }
+    }
+    if (writer->len <= writer->max_len) {
+        write_literal(writer, value + pos - literal, literal + len - pos);
+    }
+
+    return writer->len;
+}
+#endif /* EF_ENV_USING_COMPRESS */
+
+/*
+ * Calculate the CRC32 value of ENV header and name, @see calc_env_crc32
+ */
+static uint32_t calc_env_hdr_crc32(env_hdr_data_t env_hdr, const char *key)
+{
+    uint8_t ff = 0xFF;
+    uint32_t crc32;
+    size_t align_remain;
+
+    crc32 = ef_calc_crc32(0, &env_hdr->name_len, ENV_HDR_DATA_SIZE - ENV_NAME_LEN_OFFSET);
+    crc32 = ef_calc_crc32(crc32, key, env_hdr->name_len);
+    align_remain = EF_WG_ALIGN(env_hdr->name_len) - env_hdr->name_len;
+    while (align_remain--) {
+        crc32 = ef_calc_crc32(crc32, &ff, 1);
+    }
+
+    return crc32;
+}
+
+/*
+ * Initialize the new ENV header and calculate the CRC32. The compressed value is used only when it's smaller than the
+ * original value by at least one write granularity, so the value is compressed (dry run) once for length and CRC32.
+ * The counter ENV step table is reserved behind the value, @see ef_env_counter_inc
+ */
+static void init_env_hdr(env_hdr_data_t env_hdr, const char *key, const void *value, size_t len, bool is_counter)
+{
+    size_t store_len = len, align_remain;
+    uint8_t ff = 0xFF;
+
+#ifdef EF_ENV_USING_COMPRESS
+    struct data_writer writer;
+#endif
+
+    memset(env_hdr, 0xFF, sizeof(struct env_hdr_data));
+    env_hdr->magic = ENV_MAGIC_WORD;
+    env_hdr->name_len = strlen(key);
+    env_hdr->value_len = len;
+
+#ifdef EF_ENV_USING_COMPRESS
+    if (!is_counter && EF_WG_ALIGN(len) > EF_WG_ALIGN(1)) {
+        env_hdr->flag &= ~ENV_FLAG_COMPRESSED;
+        init_data_writer(&writer, FAILED_ADDR, calc_env_hdr_crc32(env_hdr, key));
+        writer.max_len = EF_WG_ALIGN(len) - EF_WG_ALIGN(1);
+        if (compress_value(value, len, &writer) <= writer.max_len) {
+            flush_data_writer(&writer);
+            store_len = writer.len;
+        } else {
+            env_hdr->flag |= ENV_FLAG_COMPRESSED;
+        }
+    }
+    if (!(env_hdr->flag & ENV_FLAG_COMPRESSED)) {
+        /* the compressed value CRC32 has been calculated when compress */
+        env_hdr->crc32 = writer.crc32;
+    } else
+#endif /* EF_ENV_USING_COMPRESS */
+    {
+        env_hdr->crc32 = calc_env_hdr_crc32(env_hdr, key);
+        env_hdr->crc32 = ef_calc_crc32(env_hdr->crc32, value, len);
+    }
+    align_remain = EF_WG_ALIGN(store_len) - store_len;
+    while (align_remain--) {
+        env_hdr->crc32 = ef_calc_crc32(env_hdr->crc32, &ff, 1);
+    }
+
+    env_hdr->len = ENV_HDR_DATA_SIZE + EF_WG_ALIGN(env_hdr->name_len) + EF_WG_ALIGN(store_len);
+    if (is_counter) {
+        env_hdr->len += ENV_COUNTER_TABLE_SIZE;
+    }
+}
+
+/*
+ * Write the ENV which header has been initialized by init_env_hdr on the sector's empty ENV address,
+ * then the sector's empty ENV address will be moved to next.
+ * The pre-write ENV will keep ENV_PRE_WRITE status until it's committed, @see commit_env and commit_batch_env
+ */
+static EfErrCode write_env_blob(sector_meta_data_t sector, const char *key, const void *value, env_hdr_data_t env_hdr,
+        bool pre_write)
+{
+    EfErrCode result = EF_NO_ERR;
+    bool is_full = false;
+    uint32_t env_addr = sector->empty_env;
+    struct data_writer writer;
+
+    if (env_hdr->len > ENV_MAX_SIZE) {
+        EF_INFO("Error: The ENV size is too big\n");
+        return EF_ENV_FULL;
+    }
+
+    if (env_addr != FAILED_ADDR || (env_addr = new_env(sector, env_hdr->len, false)) != FAILED_ADDR) {
+        /* update the sector status */
+        if (result == EF_NO_ERR) {
+            result = update_sec_status(sector, env_hdr->len, &is_full);
+        }
+        if (result == EF_NO_ERR) {
+            /* the ENV will be recovered by the PRE_WRITE status when power fail before the ENV_WRITE status */
+            result = write_status(env_addr, env_hdr->status_table, ENV_STATUS_NUM, ENV_PRE_WRITE);
+        }
+        /* write the other header data, key name and value, they are merged then written by page */
+        if (result == EF_NO_ERR) {
+            init_data_writer(&writer, env_addr + ENV_MAGIC_OFFSET, 0);
+            write_data(&writer, &env_hdr->magic, sizeof(struct env_hdr_data) - ENV_MAGIC_OFFSET);
+            write_data_padding(&writer);
+            write_data(&writer, key, env_hdr->name_len);
+            write_data_padding(&writer);
+#ifdef EF_ENV_USING_COMPRESS
+            if (!(env_hdr->flag & ENV_FLAG_COMPRESSED)) {
+                compress_value(value, env_hdr->value_len, &writer);
+            } else
+#endif
+            {
+                write_data(&writer, value, env_hdr->value_len);
+            }
+            flush_data_writer(&writer);
+            result = writer.result;
+        }
+        if (result == EF_NO_ERR) {
+#ifdef EF_ENV_USING_CACHE
+            if (!is_full) {
+                update_sector_cache(sector->addr, env_addr + env_hdr->len);
+            }
+            if (!pre_write) {
+                update_env_cache(key, env_hdr->name_len, env_addr);
+            }
+#endif /* EF_ENV_USING_CACHE */
+
+#ifdef EF_ENV_USING_INDEX
+            if (!pre_write) {
+                update_env_index(key, env_hdr->name_len, env_addr);
+            }
+#endif
+
+#ifdef EF_ENV_USING_BLOOM
+            if (!pre_write) {
+                env_bloom_add(key, env_hdr->name_len);
+            }
+#endif
+        }
+        /* change the ENV status to ENV_WRITE */
+        if (result == EF_NO_ERR && !pre_write) {
+            result = write_status(env_addr, env_hdr->status_table, ENV_STATUS_NUM, ENV_WRITE);
+        }
+        /* move the empty ENV address to next, a full or write failed sector will NOT be used again */
+        if (result == EF_NO_ERR && !is_full) {
+            sector->status.store = SECTOR_STORE_USING;
+            sector->empty_env = env_addr + env_hdr->len;
+            sector->remain -= env_hdr->len;
+        } else {
+            sector->empty_env = FAILED_ADDR;
+        }
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+        if (result == EF_NO_ERR) {
+            alloc_sector_map_env(env_addr, env_hdr->len);
+        } else {
+            reload_sector_map(env_addr);
+        }
+#endif
+        /* trigger GC collect when current sector is full */
+        if (result == EF_NO_ERR && is_full) {
+            EF_DEBUG("Trigger a GC check after created ENV.\n");
+            gc_request = true;
+
+#ifdef EF_ENV_USING_HOT_COLD
+            env_hot_decay();
+#endif
+        }
+    } else {
+        result = EF_ENV_FULL;
+    }
+
+    return result;
+}
+
+/*
+ * Create an ENV on the sector's empty ENV address, @see write_env_blob
+ */
+static EfErrCode create_env_blob(sector_meta_data_t sector, const char *key, const void *value, size_t len,
+        bool is_counter, bool pre_write)
+{
+    struct env_hdr_data env_hdr;
+
+    if (strlen(key) > EF_ENV_NAME_MAX) {
+        EF_INFO("Error: The ENV name length is more than %d\n", EF_ENV_NAME_MAX);
+        return EF_ENV_NAME_ERR;
+    }
+
+    init_env_hdr(&env_hdr, key, value, len, is_counter);
+
+    return write_env_blob(sector, key, value, &env_hdr, pre_write);
+}
+
+/**
+ * Delete an ENV.
+ *
+ * @param key ENV name
+ *
+ * @return result
+ */
+EfErrCode ef_del_env(const char *key)
+{
+    EfErrCode result = EF_NO_ERR;
+
+    if (!init_ok) {
+        EF_INFO("Error: ENV isn't initialize OK.\n");
+        return EF_ENV_INIT_FAILED;
+    }
+
+    if (env_name_is_reserved(key, strlen(key))) {
+        EF_INFO("Error: The ENV name (%s) is reserved.\n", key);
+        return EF_ENV_NAME_ERR;
+    }
+
+    /* lock the ENV cache */
+    ef_port_env_lock();
+
+    result = del_env(key, NULL, true);
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
+
+    return result;
+}
+
+/**
+ * The same to ef_del_env on this mode
+ * It's compatibility with older versions (less then V4.0).
+ *
+ * @note this function is DEPRECATED
+ *
+ * @param key ENV name
+ *
+ * @return result
+ */
+EfErrCode ef_del_and_save_env(const char *key)
+{
+    return ef_del_env(key);
+}
+
+/*
+ * Commit the new ENV which has been written completely with ENV_PRE_WRITE status, then delete the old ENV.
+ * The old ENV is still valid before it's prepare deleted, and the new ENV will be committed on next load
+ * when the power is down after the old ENV is prepare deleted, @see check_and_recovery_pre_write_cb
+ */
+static EfErrCode commit_env(const char *key, uint32_t env_addr, env_node_obj_t old_env)
+{
+    EfErrCode result = EF_NO_ERR;
+    uint8_t status_table[ENV_STATUS_TABLE_SIZE];
+
+    /* prepare to delete the old ENV */
+    if (old_env) {
+        result = del_env(key, old_env, false);
+
+#ifdef EF_ENV_USING_HOT_COLD
+        env_hot_update(key, strlen(key));
+#endif
+    }
+    /* change the ENV status to ENV_WRITE */
+    if (result == EF_NO_ERR) {
+        result = write_status(env_addr, status_table, ENV_STATUS_NUM, ENV_WRITE);
+    }
+    if (result == EF_NO_ERR) {
+#ifdef EF_ENV_USING_CACHE
+        update_env_cache(key, strlen(key), env_addr);
+#endif
+
+#ifdef EF_ENV_USING_INDEX
+        update_env_index(key, strlen(key), env_addr);
+#endif
 
-    for (i = 0; i < len; i++) {
-        if (!__is_print(value[i])) {
-            return false;
-        }
+#ifdef EF_ENV_USING_BLOOM
+        env_bloom_add(key, strlen(key));
+#endif
     }
-    return true;
+    /* delete the old ENV */
+    if (old_env && result == EF_NO_ERR) {
+        result = del_env(key, old_env, true);
+    }
+
+    return result;
 }
 
-static size_t get_env(const char *key, void *value_buf, size_t buf_len, size_t *value_len)
+static EfErrCode set_env(const char *key, const void *value_buf, size_t buf_len, bool is_counter)
 {
-    struct env_node_obj env;
-    size_t read_len = 0;
+    EfErrCode result = EF_NO_ERR;
+    static struct env_node_obj env;
+    static struct sector_meta_data sector;
+    struct env_hdr_data env_hdr;
+    bool env_is_found = false, hot = false;
+    uint32_t env_addr;
 
-    if (find_env(key, &env)) {
-        if (value_len) {
-            *value_len = env.value_len;
+    if (value_buf == NULL) {
+        result = del_env(key, NULL, true);
+    } else {
+        /* check the ENV before alloc, the combined sector will be erased when it's allocated */
+        if (strlen(key) > EF_ENV_NAME_MAX) {
+            EF_INFO("Error: The ENV name length is more than %d\n", EF_ENV_NAME_MAX);
+            return EF_ENV_NAME_ERR;
         }
-        if (buf_len > env.value_len) {
-            read_len = env.value_len;
-        } else {
-            read_len = buf_len;
+        /* the header is initialized once, the value compression is NOT repeated for the size and CRC32 */
+        init_env_hdr(&env_hdr, key, value_buf, buf_len, is_counter);
+        if (env_hdr.len > ENV_MAX_SIZE) {
+            EF_INFO("Error: The ENV size is too big\n");
+            return EF_ENV_FULL;
         }
-        if (value_buf){
-            ef_port_read(env.addr.value, (uint32_t *) value_buf, read_len);
+#ifdef EF_ENV_USING_HOT_COLD
+        hot = env_is_hot(key, strlen(key));
+#endif
+        /* make sure the flash has enough space */
+        if (new_env(&sector, env_hdr.len, hot) == FAILED_ADDR) {
+            return EF_ENV_FULL;
+        }
+        env_is_found = find_env(key, &env);
+        /* create the new ENV, the old ENV is still valid until the new one is committed */
+        env_addr = sector.empty_env;
+        result = write_env_blob(&sector, key, value_buf, &env_hdr, true);
+        if (result == EF_NO_ERR) {
+            result = commit_env(key, env_addr, env_is_found ? &env : NULL);
+        }
+        /* process the GC after set ENV */
+        if (gc_request) {
+            gc_collect();
         }
-    } else if (value_len) {
-        *value_len = 0;
     }
 
-    return read_len;
+    return result;
 }
 
 /**
- * Get a ENV object by key name
+ * Set a blob ENV. If it value is NULL, delete it.
+ * If not find it in flash, then create it.
  *
  * @param key ENV name
- * @param env ENV object
+ * @param value ENV value
+ * @param len ENV value length
  *
- * @return TRUE: find the ENV is OK, else return false
+ * @return result
  */
-bool ef_get_env_obj(const char *key, env_node_obj_t env)
+EfErrCode ef_set_env_blob(const char *key, const void *value_buf, size_t buf_len)
 {
-    bool find_ok = false;
+    EfErrCode result = EF_NO_ERR;
+
 
     if (!init_ok) {
         EF_INFO("ENV isn't initialize OK.\n");
-        return 0;
+        return EF_ENV_INIT_FAILED;
+    }
+
+    if (env_name_is_reserved(key, strlen(key))) {
+        EF_INFO("Error: The ENV name (%s) is reserved.\n", key);
+        return EF_ENV_NAME_ERR;
     }
 
     /* lock the ENV cache */
     ef_port_env_lock();
 
-    find_ok = find_env(key, env);
+    result = set_env(key, value_buf, buf_len, false);
 
     /* unlock the ENV cache */
     ef_port_env_unlock();
 
-    return find_ok;
+    return result;
 }
 
 /**
- * Get a blob ENV value by key name.
+ * Set a string ENV. If it value is NULL, delete it.
+ * If not find it in flash, then create it.
  *
  * @param key ENV name
- * @param value_buf ENV blob buffer
- * @param buf_len ENV blob buffer length
- * @param saved_value_len return the length of the value saved on the flash, 0: NOT found
+ * @param value ENV value
  *
- * @return the actually get size on successful
+ * @return result
  */
-size_t ef_get_env_blob(const char *key, void *value_buf, size_t buf_len, size_t *saved_value_len)
+EfErrCode ef_set_env(const char *key, const char *value)
 {
-    size_t read_len = 0;
-
-    if (!init_ok) {
-        EF_INFO("ENV isn't initialize OK.\n");
-        return 0;
-    }
-
-    /* lock the ENV cache */
-    ef_port_env_lock();
-
-    read_len = get_env(key, value_buf, buf_len, saved_value_len);
-
-    /* unlock the ENV cache */
-    ef_port_env_unlock();
-
-    return read_len;
+    return ef_set_env_blob(key, value, strlen(value));
 }
 
 /**
- * Get an ENV value by key name.
+ * The same to ef_set_env on this mode.
+ * It's compatibility with older versions (less then V4.0).
  *
- * @note this function is NOT supported reentrant
  * @note this function is DEPRECATED
  *
  * @param key ENV name
+ * @param value ENV value
  *
- * @return value
+ * @return result
  */
-char *ef_get_env(const char *key)
+EfErrCode ef_set_and_save_env(const char *key, const char *value)
 {
-    static char value[EF_STR_ENV_VALUE_MAX_SIZE + 1];
-    size_t get_size;
+    return ef_set_env_blob(key, value, strlen(value));
+}
 
-    if ((get_size = ef_get_env_blob(key, value, EF_STR_ENV_VALUE_MAX_SIZE, NULL)) > 0) {
-        /* the return value must be string */
-        if (ef_is_str((uint8_t *)value, get_size)) {
-            value[get_size] = '\0';
-            return value;
-        } else {
-            EF_INFO("Warning: The ENV value isn't string. Could not be returned\n");
-            return NULL;
+static EfErrCode env_counter_inc(const char *key, uint32_t *value)
+{
+    EfErrCode result = EF_NO_ERR;
+    static struct env_node_obj env;
+    uint32_t counter = 0, table_addr;
+    size_t steps;
+
+    if (find_env(key, &env)) {
+        if (env.value_len != sizeof(uint32_t)) {
+            EF_INFO("Error: The ENV (%s) value length is NOT %d, it's NOT a counter.\n", key, sizeof(uint32_t));
+            return EF_ENV_NAME_ERR;
+        }
+        flash_read(env.addr.value, &counter, sizeof(uint32_t));
+        if (env_is_counter(env.len, env.name_len, env.value_len)) {
+            table_addr = env.addr.value + EF_WG_ALIGN(env.value_len);
+            steps = read_counter_steps(table_addr);
+            if (steps < EF_ENV_COUNTER_STEPS) {
+                /* only mark the next step in place */
+                result = mark_counter_step(table_addr, steps + 1);
+                if (result == EF_NO_ERR && value) {
+                    *value = counter + steps + 1;
+                }
+
+#ifdef EF_ENV_USING_HOT_COLD
+                env_hot_update(key, strlen(key));
+#endif
+
+                return result;
+            }
+            counter += steps;
         }
     }
+    /* the ENV is NOT a counter or all steps has been marked, so rewrite it as a new counter ENV */
+    counter++;
+    result = set_env(key, &counter, sizeof(uint32_t), true);
+    if (result == EF_NO_ERR && value) {
+        *value = counter;
+    }
 
-    return NULL;
+    return result;
 }
 
 /**
- * read the ENV value by ENV object
+ * Increase the counter ENV by 1. The counter ENV has a step table behind the value, every increment only marks
+ * one step on the table in place. So it's NOT needed to write a new ENV until all steps has been marked.
+ * The counter value is an uint32_t blob, it can be read by ef_get_env_blob.
+ * @note the not exist ENV will be created from 0, and the ENV which value length is 4 will be converted to counter.
+ * The counter ENV will be a normal ENV when it's set by ef_set_env_blob.
  *
- * @param env ENV object
- * @param value_buf the buffer for store ENV value
- * @param buf_len buffer length
+ * @param key ENV name
+ * @param value the counter value after increased, it will NOT be set when it's NULL
  *
- * @return the actually read size on successful
+ * @return result
  */
-size_t ef_read_env_value(env_node_obj_t env, uint8_t *value_buf, size_t buf_len)
+EfErrCode ef_env_counter_inc(const char *key, uint32_t *value)
 {
-    size_t read_len = 0;
-
-    EF_ASSERT(env);
-    EF_ASSERT(value_buf);
+    EfErrCode result = EF_NO_ERR;
 
     if (!init_ok) {
         EF_INFO("ENV isn't initialize OK.\n");
-        return 0;
+        return EF_ENV_INIT_FAILED;
     }
 
-    if (env->crc_is_ok) {
-        /* lock the ENV cache */
-        ef_port_env_lock();
-
-        if (buf_len > env->value_len) {
-            read_len = env->value_len;
-        } else {
-            read_len = buf_len;
-        }
+    if (strlen(key) > EF_ENV_NAME_MAX) {
+        EF_INFO("Error: The ENV name length is more than %d\n", EF_ENV_NAME_MAX);
+        return EF_ENV_NAME_ERR;
+    }
 
-        ef_port_read(env->addr.value, (uint32_t *) value_buf, read_len);
-        /* unlock the ENV cache */
-        ef_port_env_unlock();
+    if (env_name_is_reserved(key, strlen(key))) {
+        EF_INFO("Error: The ENV name (%s) is reserved.\n", key);
+        return EF_ENV_NAME_ERR;
     }
 
-    return read_len;
-}
+    /* lock the ENV cache */
+    ef_port_env_lock();
 
-static EfErrCode write_env_hdr(uint32_t addr, env_hdr_data_t env_hdr) {
-    EfErrCode result = EF_NO_ERR;
-    /* write the status will by write granularity */
-    result = write_status(addr, env_hdr->status_table, ENV_STATUS_NUM, ENV_PRE_WRITE);
-    if (result != EF_NO_ERR) {
-        return result;
-    }
-    /* write other header data */
-    result = ef_port_write(addr + ENV_MAGIC_OFFSET, &env_hdr->magic, sizeof(struct env_hdr_data) - ENV_MAGIC_OFFSET);
+    result = env_counter_inc(key, value);
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
 
     return result;
 }
 
-static EfErrCode format_sector(uint32_t addr, uint32_t combined_value)
+/*
+ * Get the value length of the ENV on ENV set. It seems to be a string when value length is 0.
+ */
+static size_t get_env_set_value_len(const ef_env *env)
 {
-    EfErrCode result = EF_NO_ERR;
-    struct sector_hdr_data sec_hdr;
-
-    EF_ASSERT(addr % SECTOR_SIZE == 0);
-
-    result = ef_port_erase(addr, SECTOR_SIZE);
-    if (result == EF_NO_ERR) {
-        /* initialize the header data */
-        memset(&sec_hdr, 0xFF, sizeof(struct sector_hdr_data));
-        set_status(sec_hdr.status_table.store, SECTOR_STORE_STATUS_NUM, SECTOR_STORE_EMPTY);
-        set_status(sec_hdr.status_table.dirty, SECTOR_DIRTY_STATUS_NUM, SECTOR_DIRTY_FALSE);
-        sec_hdr.magic = SECTOR_MAGIC_WORD;
-        sec_hdr.combined = combined_value;
-        sec_hdr.reserved = 0xFFFFFFFF;
-        /* save the header */
-        result = ef_port_write(addr, (uint32_t *)&sec_hdr, sizeof(struct sector_hdr_data));
+    return env->value_len == 0 ? strlen(env->value) : env->value_len;
+}
 
-#ifdef EF_ENV_USING_CACHE
-        /* delete the sector cache */
-        update_sector_cache(addr, addr + SECTOR_SIZE);
-#endif /* EF_ENV_USING_CACHE */
+/*
+ * Get the ENV length of the index on batch, the commit ENV is after all batch ENV.
+ */
+static size_t get_batch_env_len(const ef_env *env_set, size_t env_num, size_t index)
+{
+    if (index < env_num) {
+        return ENV_HDR_DATA_SIZE + EF_WG_ALIGN(strlen(env_set[index].key))
+                + EF_WG_ALIGN(get_env_set_value_len(&env_set[index]));
+    } else {
+        return ENV_HDR_DATA_SIZE + EF_WG_ALIGN(sizeof(BATCH_ENV_NAME) - 1) + EF_WG_ALIGN(env_num * sizeof(uint32_t));
     }
-
-    return result;
 }
 
-static EfErrCode update_sec_status(sector_meta_data_t sector, size_t new_env_len, bool *is_full)
+/*
+ * Get the next sector for the batch ENV by address order. The using sector and the dirty sector are allocable,
+ * the empty sector is allocable only when the empty sector number is greater than the GC threshold.
+ */
+static uint32_t get_next_batch_sector(sector_meta_data_t sector, size_t *empty_sec)
 {
-    uint8_t status_table[STORE_STATUS_TABLE_SIZE];
-    EfErrCode result = EF_NO_ERR;
-    /* change the current sector status */
-    if (sector->status.store == SECTOR_STORE_EMPTY) {
-        /* change the sector status to using */
-        result = write_status(sector->addr, status_table, SECTOR_STORE_STATUS_NUM, SECTOR_STORE_USING);
-    } else if (sector->status.store == SECTOR_STORE_USING) {
-        /* check remain size */
-        if (sector->remain < EF_SEC_REMAIN_THRESHOLD || sector->remain - new_env_len < EF_SEC_REMAIN_THRESHOLD) {
-            /* change the sector status to full */
-            result = write_status(sector->addr, status_table, SECTOR_STORE_STATUS_NUM, SECTOR_STORE_FULL);
-
-#ifdef EF_ENV_USING_CACHE
-            /* delete the sector cache */
-            update_sector_cache(sector->addr, sector->addr + SECTOR_SIZE);
-#endif /* EF_ENV_USING_CACHE */
-
-            if (is_full) {
-                *is_full = true;
-            }
-        } else if (is_full) {
-            *is_full = false;
+    while ((sector->addr = get_next_sector_addr(sector)) != FAILED_ADDR) {
+        read_sector_meta_data(sector->addr, sector, true);
+        if (!sector->check_ok || sector->status.dirty == SECTOR_DIRTY_GC) {
+            continue;
+        } else if (sector->status.store == SECTOR_STORE_USING) {
+            return sector->addr;
+        } else if (sector->status.store == SECTOR_STORE_EMPTY && *empty_sec > EF_GC_EMPTY_SEC_THRESHOLD) {
+            (*empty_sec)--;
+            return sector->addr;
         }
     }
 
-    return result;
+    return FAILED_ADDR;
 }
 
-static void sector_iterator(sector_meta_data_t sector, sector_store_status_t status, void *arg1, void *arg2,
-        bool (*callback)(sector_meta_data_t sector, void *arg1, void *arg2), bool traversal_env) {
-    uint32_t sec_addr;
+/*
+ * Check the flash has enough space for all batch ENV and the commit ENV, the reserved empty sectors for GC is
+ * NOT included. It simulates the next fit sector allocation of set_env_batch.
+ */
+static bool batch_has_space(const ef_env *env_set, size_t env_num)
+{
+    struct sector_meta_data sector;
+    size_t i = 0, empty_sec = 0, remain = 0, env_len;
+    bool is_using = false;
 
-    /* search all sectors */
-    sector->addr = FAILED_ADDR;
-    while ((sec_addr = get_next_sector_addr(sector)) != FAILED_ADDR) {
-        read_sector_meta_data(sec_addr, sector, false);
-        if (status == SECTOR_STORE_UNUSED || status == sector->status.store) {
-            if (traversal_env) {
-                read_sector_meta_data(sec_addr, sector, traversal_env);
-            }
-            /* iterator is interrupted when callback return true */
-            if (callback && callback(sector, arg1, arg2)) {
-                return;
+    sector_iterator(&sector, SECTOR_STORE_EMPTY, &empty_sec, NULL, gc_check_cb, false);
+
+    sector.addr = FAILED_ADDR;
+    while (i <= env_num) {
+        env_len = get_batch_env_len(env_set, env_num, i);
+        if (remain > env_len) {
+            /* the using sector will be full when the remain size is less than threshold, @see update_sec_status */
+            if (is_using && remain - env_len < EF_SEC_REMAIN_THRESHOLD) {
+                remain = 0;
+            } else {
+                remain -= env_len;
             }
+            is_using = true;
+            i++;
+            continue;
         }
+        /* place the ENV on next sector */
+        if (get_next_batch_sector(&sector, &empty_sec) == FAILED_ADDR) {
+            return false;
+        }
+        remain = sector.remain;
+        is_using = sector.status.store == SECTOR_STORE_USING;
     }
+
+    return true;
 }
 
-static bool sector_statistics_cb(sector_meta_data_t sector, void *arg1, void *arg2)
+/*
+ * Commit the batch ENV, the old ENV which has same name will be deleted, then the batch ENV will be changed to
+ * ENV_WRITE status. It's also used for recovery, so the ENV maybe committed already.
+ */
+static EfErrCode commit_batch_env(env_node_obj_t env)
 {
-    size_t *empty_sector = arg1, *using_sector = arg2;
+    EfErrCode result = EF_NO_ERR;
+    struct env_node_obj old_env;
+    uint8_t status_table[ENV_STATUS_TABLE_SIZE];
+    char name[EF_ENV_NAME_MAX + 1] = { 0 };
 
-    if (sector->check_ok && sector->status.store == SECTOR_STORE_EMPTY) {
-        (*empty_sector)++;
-    } else if (sector->check_ok && sector->status.store == SECTOR_STORE_USING) {
-        (*using_sector)++;
+    strncpy(name, env->name, env->name_len);
+    /* the previous same name ENV on this batch is the old ENV too */
+    if (find_env(name, &old_env) && old_env.addr.start != env->addr.start) {
+        result = del_env(name, &old_env, true);
     }
+    if (result == EF_NO_ERR && env->status == ENV_PRE_WRITE) {
+        result = write_status(env->addr.start, status_table, ENV_STATUS_NUM, ENV_WRITE);
+        if (result == EF_NO_ERR) {
+            env->status = ENV_WRITE;
 
-    return false;
-}
+#ifdef EF_ENV_USING_CACHE
+            update_env_cache(env->name, env->name_len, env->addr.start);
+#endif
 
-static bool alloc_env_cb(sector_meta_data_t sector, void *arg1, void *arg2)
-{
-    size_t *env_size = arg1;
-    uint32_t *empty_env = arg2;
+#ifdef EF_ENV_USING_INDEX
+            update_env_index(env->name, env->name_len, env->addr.start);
+#endif
 
-    /* 1. sector has space
-     * 2. the NO dirty sector
-     * 3. the dirty sector only when the gc_request is false */
-    if (sector->check_ok && sector->remain > *env_size
-            && ((sector->status.dirty == SECTOR_DIRTY_FALSE)
-                    || (sector->status.dirty == SECTOR_DIRTY_TRUE && !gc_request))) {
-        *empty_env = sector->empty_env;
-        return true;
+#ifdef EF_ENV_USING_BLOOM
+            env_bloom_add(env->name, env->name_len);
+#endif
+        }
     }
 
-    return false;
+    return result;
 }
 
-static uint32_t alloc_env(sector_meta_data_t sector, size_t env_size)
+/*
+ * Recovery the batch which has been committed but NOT finished when power down.
+ * The uncommitted batch ENV will be changed to ENV_ERR_HDR status by check_and_recovery_env_cb.
+ */
+static void recovery_batch(void)
 {
-    uint32_t empty_env = FAILED_ADDR;
-    size_t empty_sector = 0, using_sector = 0;
+    struct env_node_obj commit_env, env;
+    uint32_t env_addr[EF_ENV_BATCH_MAX];
+    size_t i, env_num;
 
-    /* sector status statistics */
-    sector_iterator(sector, SECTOR_STORE_UNUSED, &empty_sector, &using_sector, sector_statistics_cb, false);
-    if (using_sector > 0) {
-        /* alloc the ENV from the using status sector first */
-        sector_iterator(sector, SECTOR_STORE_USING, &env_size, &empty_env, alloc_env_cb, true);
+    if (!find_env_no_cache(BATCH_ENV_NAME, &commit_env)) {
+        return;
     }
-    if (empty_sector > 0 && empty_env == FAILED_ADDR) {
-        if (empty_sector > EF_GC_EMPTY_SEC_THRESHOLD || gc_request) {
-            sector_iterator(sector, SECTOR_STORE_EMPTY, &env_size, &empty_env, alloc_env_cb, true);
-        } else {
-            /* no space for new ENV now will GC and retry */
-            EF_DEBUG("Trigger a GC check after alloc ENV failed.\n");
-            gc_request = true;
+
+    EF_INFO("Found an unfinished ENV batch. Now will recovery it.\n");
+    env_num = commit_env.value_len / sizeof(uint32_t);
+    if (env_num > EF_ENV_BATCH_MAX) {
+        env_num = EF_ENV_BATCH_MAX;
+    }
+    env_num = read_env_value(&commit_env, 0, env_addr, env_num * sizeof(uint32_t)) / sizeof(uint32_t);
+    for (i = 0; i < env_num; i++) {
+        env.addr.start = env_addr[i];
+        read_env(&env);
+        if (env.crc_is_ok && (env.status == ENV_PRE_WRITE || env.status == ENV_WRITE)) {
+            commit_batch_env(&env);
         }
     }
-
-    return empty_env;
+    del_env(BATCH_ENV_NAME, &commit_env, true);
 }
 
-static EfErrCode del_env(const char *key, env_node_obj_t old_env, bool complete_del) {
+static EfErrCode set_env_batch(const ef_env *env_set, size_t env_num)
+{
     EfErrCode result = EF_NO_ERR;
-    uint32_t dirty_status_addr;
-    static bool last_is_complete_del = false;
+    uint32_t env_addr[EF_ENV_BATCH_MAX], commit_addr = FAILED_ADDR;
+    struct sector_meta_data sector;
+    struct env_node_obj env;
+    size_t i, written_num = 0, env_len, empty_sec = 0;
+    bool already_gc = false, need_gc = gc_request;
 
-#if (ENV_STATUS_TABLE_SIZE >= DIRTY_STATUS_TABLE_SIZE)
-    uint8_t status_table[ENV_STATUS_TABLE_SIZE];
-#else
-    uint8_t status_table[DIRTY_STATUS_TABLE_SIZE];
-#endif
+    /* reserve the space for all ENV, the GC will NOT be done when the batch is writing */
+    if (!batch_has_space(env_set, env_num)) {
+        /* the GC can use the reserved empty sectors when GC is requested */
+        gc_request = true;
+        gc_collect();
+        already_gc = true;
+        if (!batch_has_space(env_set, env_num)) {
+            return EF_ENV_FULL;
+        }
+    }
 
-    /* need find ENV */
-    if (!old_env) {
-        struct env_node_obj env;
-        /* find ENV */
-        if (find_env(key, &env)) {
-            old_env = &env;
+    /* write all ENV back to back, they are invisible before the batch is committed */
+    sector_iterator(&sector, SECTOR_STORE_EMPTY, &empty_sec, NULL, gc_check_cb, false);
+    sector.addr = FAILED_ADDR;
+    sector.empty_env = FAILED_ADDR;
+    for (i = 0; i <= env_num && result == EF_NO_ERR; i++) {
+        env_len = get_batch_env_len(env_set, env_num, i);
+        /* defer the GC request until the batch is finished */
+        need_gc = need_gc || gc_request;
+        gc_request = false;
+        /* the sectors are allocated as same as batch_has_space() */
+        while (result == EF_NO_ERR && (sector.empty_env == FAILED_ADDR || sector.remain <= env_len)) {
+            if (get_next_batch_sector(&sector, &empty_sec) == FAILED_ADDR) {
+                result = EF_ENV_FULL;
+            }
+        }
+        if (result != EF_NO_ERR) {
+            break;
+        }
+        if (i < env_num) {
+            env_addr[i] = sector.empty_env;
+            result = create_env_blob(&sector, env_set[i].key, env_set[i].value, get_env_set_value_len(&env_set[i]),
+                    false, true);
+            written_num++;
         } else {
-            EF_DEBUG("Not found '%s' in ENV.\n", key);
-            return EF_ENV_NAME_ERR;
+            /* the batch is committed when the commit ENV has been written */
+            commit_addr = sector.empty_env;
+            result = create_env_blob(&sector, BATCH_ENV_NAME, env_addr, env_num * sizeof(uint32_t), false, false);
         }
     }
-    /* change and save the new status */
-    if (!complete_del) {
-        result = write_status(old_env->addr.start, status_table, ENV_STATUS_NUM, ENV_PRE_DELETE);
-        last_is_complete_del = true;
-    } else {
-        result = write_status(old_env->addr.start, status_table, ENV_STATUS_NUM, ENV_DELETED);
 
-        if (!last_is_complete_del && result == EF_NO_ERR) {
-#ifdef EF_ENV_USING_CACHE
-            /* delete the ENV in flash and cache */
-            if (key != NULL) {
-                /* when using del_env(key, NULL, true) or del_env(key, env, true) in ef_del_env() and set_env() */
-                update_env_cache(key, strlen(key), FAILED_ADDR);
-            } else if (old_env != NULL) {
-                /* when using del_env(NULL, env, true) in move_env() */
-                update_env_cache(old_env->name, old_env->name_len, FAILED_ADDR);
-            }
-#endif /* EF_ENV_USING_CACHE */
+    if (result != EF_NO_ERR && commit_addr != FAILED_ADDR) {
+        /* the commit ENV maybe has been written when the write failed */
+        env.addr.start = commit_addr;
+        read_env(&env);
+        if (env.crc_is_ok && env.status == ENV_WRITE) {
+            result = EF_NO_ERR;
         }
+    }
 
-        last_is_complete_del = false;
+    if (result == EF_NO_ERR) {
+        for (i = 0; i < env_num && result == EF_NO_ERR; i++) {
+            env.addr.start = env_addr[i];
+            read_env(&env);
+            result = commit_batch_env(&env);
+        }
+        /* the batch is finished */
+        if (result == EF_NO_ERR) {
+            env.addr.start = commit_addr;
+            read_env(&env);
+            result = del_env(BATCH_ENV_NAME, &env, true);
+        }
+    } else {
+        EF_INFO("Error: Write the ENV batch failed, all ENV in the batch will be discarded.\n");
+        /* discard the written batch ENV, the broken ENV will be discarded when next load */
+        for (i = 0; i < written_num; i++) {
+            env.addr.start = env_addr[i];
+            read_env(&env);
+            if (env.crc_is_ok) {
+                del_env(NULL, &env, true);
+            }
+        }
     }
 
-    dirty_status_addr = EF_ALIGN_DOWN(old_env->addr.start, SECTOR_SIZE) + SECTOR_DIRTY_OFFSET;
-    /* read and change the sector dirty status */
-    if (result == EF_NO_ERR
-            && read_status(dirty_status_addr, status_table, SECTOR_DIRTY_STATUS_NUM) == SECTOR_DIRTY_FALSE) {
-        result = write_status(dirty_status_addr, status_table, SECTOR_DIRTY_STATUS_NUM, SECTOR_DIRTY_TRUE);
+    /* process the GC after the batch is finished, it's only once on a batch */
+    gc_request = gc_request || need_gc;
+    if (gc_request && !already_gc) {
+        gc_collect();
     }
 
     return result;
 }
 
-/*
- * move the ENV to new space
+/**
+ * Set a batch of ENV atomically. All ENV on the batch will be saved or none of them will be saved
+ * even if the power is down. The ENV on the batch will be written sequentially, and the GC will be done once at most.
+ *
+ * @param env_set the ENV set, it's same as the default ENV set. the value length 0 means it's a string.
+ * @param env_num the ENV number on the set, it must be less than or equal to EF_ENV_BATCH_MAX
+ *
+ * @return result
  */
-static EfErrCode move_env(env_node_obj_t env)
+EfErrCode ef_set_env_batch(const ef_env *env_set, size_t env_num)
 {
     EfErrCode result = EF_NO_ERR;
-    uint8_t status_table[ENV_STATUS_TABLE_SIZE];
-    uint32_t env_addr;
-    struct sector_meta_data sector;
+    size_t i, env_len;
 
-    /* prepare to delete the current ENV */
-    if (env->status == ENV_WRITE) {
-        del_env(NULL, env, false);
+    EF_ASSERT(env_set);
+
+    if (!init_ok) {
+        EF_INFO("ENV isn't initialize OK.\n");
+        return EF_ENV_INIT_FAILED;
     }
 
-    if ((env_addr = alloc_env(&sector, env->len)) != FAILED_ADDR) {
-        if (in_recovery_check) {
-            struct env_node_obj env_bak;
-            char name[EF_ENV_NAME_MAX + 1] = { 0 };
-            strncpy(name, env->name, env->name_len);
-            /* check the ENV in flash is already create success */
-            if (find_env_no_cache(name, &env_bak)) {
-                /* already create success, don't need to duplicate */
-                result = EF_NO_ERR;
-                goto __exit;
-            }
-        }
-    } else {
+    if (env_num == 0 || env_num > EF_ENV_BATCH_MAX) {
+        EF_INFO("Error: The ENV batch number is more than %d.\n", EF_ENV_BATCH_MAX);
         return EF_ENV_FULL;
     }
-    /* start move the ENV */
-    {
-        uint8_t buf[32];
-        size_t len, size, env_len = env->len;
 
-        /* update the new ENV sector status first */
-        update_sec_status(&sector, env->len, NULL);
-
-        write_status(env_addr, status_table, ENV_STATUS_NUM, ENV_PRE_WRITE);
-        env_len -= ENV_MAGIC_OFFSET;
-        for (len = 0, size = 0; len < env_len; len += size) {
-            if (len + sizeof(buf) < env_len) {
-                size = sizeof(buf);
-            } else {
-                size = env_len - len;
-            }
-            ef_port_read(env->addr.start + ENV_MAGIC_OFFSET + len, (uint32_t *) buf, EF_WG_ALIGN(size));
-            result = ef_port_write(env_addr + ENV_MAGIC_OFFSET + len, (uint32_t *) buf, size);
+    for (i = 0; i < env_num; i++) {
+        if (env_set[i].key == NULL || env_set[i].value == NULL || strlen(env_set[i].key) > EF_ENV_NAME_MAX
+                || env_name_is_reserved(env_set[i].key, strlen(env_set[i].key))) {
+            EF_INFO("Error: The ENV name or value on batch is invalid.\n");
+            return EF_ENV_NAME_ERR;
+        }
+        env_len = ENV_HDR_DATA_SIZE + EF_WG_ALIGN(strlen(env_set[i].key))
+                + EF_WG_ALIGN(get_env_set_value_len(&env_set[i]));
+        if (env_len > SECTOR_SIZE - SECTOR_HDR_DATA_SIZE) {
+            EF_INFO("Error: The ENV size is too big\n");
+            return EF_ENV_FULL;
         }
-        write_status(env_addr, status_table, ENV_STATUS_NUM, ENV_WRITE);
-
-#ifdef EF_ENV_USING_CACHE
-        update_sector_cache(EF_ALIGN_DOWN(env_addr, SECTOR_SIZE),
-                env_addr + ENV_HDR_DATA_SIZE + EF_WG_ALIGN(env->name_len) + EF_WG_ALIGN(env->value_len));
-        update_env_cache(env->name, env->name_len, env_addr);
-#endif /* EF_ENV_USING_CACHE */
     }
 
-    EF_DEBUG("Moved the ENV (%.*s) from 0x%08X to 0x%08X.\n", env->name_len, env->name, env->addr.start, env_addr);
+    /* lock the ENV cache */
+    ef_port_env_lock();
 
-__exit:
-    del_env(NULL, env, true);
+    result = set_env_batch(env_set, env_num);
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
 
     return result;
 }
 
-static uint32_t new_env(sector_meta_data_t sector, size_t env_size)
+/*
+ * Discard the ENV which is writing by stream, the discarded ENV will be skipped as the broken ENV.
+ */
+static void discard_env_writer(void)
 {
-    bool already_gc = false;
-    uint32_t empty_env = FAILED_ADDR;
+    uint8_t status_table[DIRTY_STATUS_TABLE_SIZE];
+    uint32_t dirty_status_addr = EF_ALIGN_DOWN(env_writer.addr, SECTOR_SIZE) + SECTOR_DIRTY_OFFSET;
 
-__retry:
+    write_status(env_writer.addr, env_writer.hdr.status_table, ENV_STATUS_NUM, ENV_ERR_HDR);
+    /* the discarded ENV space will be collected by GC, it's the only ENV when it's on combined sector */
+    if (read_status(dirty_status_addr, status_table, SECTOR_DIRTY_STATUS_NUM) == SECTOR_DIRTY_FALSE) {
+        write_status(dirty_status_addr, status_table, SECTOR_DIRTY_STATUS_NUM, SECTOR_DIRTY_TRUE);
 
-    if ((empty_env = alloc_env(sector, env_size)) == FAILED_ADDR && gc_request && !already_gc) {
-        EF_DEBUG("Warning: Alloc an ENV (size %d) failed when new ENV. Now will GC then retry.\n", env_size);
-        gc_collect();
-        already_gc = true;
-        goto __retry;
+#ifdef EF_ENV_USING_SECTOR_MAP
+        update_sector_map_status(dirty_status_addr, SECTOR_STORE_UNUSED, SECTOR_DIRTY_TRUE);
+#endif
     }
-
-    return empty_env;
-}
-
-static uint32_t new_env_by_kv(sector_meta_data_t sector, size_t key_len, size_t buf_len)
-{
-    size_t env_len = ENV_HDR_DATA_SIZE + EF_WG_ALIGN(key_len) + EF_WG_ALIGN(buf_len);
-
-    return new_env(sector, env_len);
+    env_writer.addr = FAILED_ADDR;
 }
 
-static bool gc_check_cb(sector_meta_data_t sector, void *arg1, void *arg2)
+static EfErrCode set_env_stream_open(const char *key, size_t value_len)
 {
-    size_t *empty_sec = arg1;
+    EfErrCode result = EF_NO_ERR;
+    struct sector_meta_data sector;
+    env_hdr_data_t env_hdr = &env_writer.hdr;
+    uint32_t env_addr;
+    size_t align_remain;
+    bool is_full = false, hot = false;
+    uint8_t ff = 0xFF;
 
-    if (sector->check_ok) {
-        *empty_sec = *empty_sec + 1;
+#ifdef EF_ENV_USING_HOT_COLD
+    hot = env_is_hot(key, strlen(key));
+#endif
+    /* make sure the flash has enough space */
+    if ((env_addr = new_env_by_kv(&sector, strlen(key), value_len, hot)) == FAILED_ADDR) {
+        return EF_ENV_FULL;
     }
 
-    return false;
-
-}
+    memset(env_hdr, 0xFF, sizeof(struct env_hdr_data));
+    env_hdr->magic = ENV_MAGIC_WORD;
+    env_hdr->name_len = strlen(key);
+    env_hdr->value_len = value_len;
+    env_hdr->len = ENV_HDR_DATA_SIZE + EF_WG_ALIGN(env_hdr->name_len) + EF_WG_ALIGN(env_hdr->value_len);
 
-static bool do_gc(sector_meta_data_t sector, void *arg1, void *arg2)
-{
-    struct env_node_obj env;
+    /* update the sector status */
+    result = update_sec_status(&sector, env_hdr->len, &is_full);
+    if (result == EF_NO_ERR) {
+        result = write_status(env_addr, env_hdr->status_table, ENV_STATUS_NUM, ENV_PRE_WRITE);
+    }
+    /* write the ENV length first to reserve the space, the CRC32 will be written when the stream is closed */
+    if (result == EF_NO_ERR) {
+        result = flash_write(env_addr + ENV_MAGIC_OFFSET, &env_hdr->magic, ENV_CRC32_OFFSET - ENV_MAGIC_OFFSET);
+    }
+    /* write key name */
+    if (result == EF_NO_ERR) {
+        result = align_write(env_addr + ENV_HDR_DATA_SIZE, (uint32_t *) key, env_hdr->name_len);
 
-    if (sector->check_ok && (sector->status.dirty == SECTOR_DIRTY_TRUE || sector->status.dirty == SECTOR_DIRTY_GC)) {
-        uint8_t status_table[DIRTY_STATUS_TABLE_SIZE];
-        /* change the sector status to GC */
-        write_status(sector->addr + SECTOR_DIRTY_OFFSET, status_table, SECTOR_DIRTY_STATUS_NUM, SECTOR_DIRTY_GC);
-        /* search all ENV */
-        env.addr.start = FAILED_ADDR;
-        while ((env.addr.start = get_next_env_addr(sector, &env)) != FAILED_ADDR) {
-            read_env(&env);
-            if (env.crc_is_ok && (env.status == ENV_WRITE || env.status == ENV_PRE_DELETE)) {
-                /* move the ENV to new space */
-                if (move_env(&env) != EF_NO_ERR) {
-                    EF_DEBUG("Error: Moved the ENV (%.*s) for GC failed.\n", env.name_len, env.name);
-                }
-            }
+#ifdef EF_ENV_USING_CACHE
+        if (!is_full) {
+            update_sector_cache(sector.addr, env_addr + env_hdr->len);
         }
-        format_sector(sector->addr, SECTOR_NOT_COMBINED);
-        EF_DEBUG("Collect a sector @0x%08X\n", sector->addr);
+#endif /* EF_ENV_USING_CACHE */
     }
 
-    return false;
-}
+#ifdef EF_ENV_USING_SECTOR_MAP
+    if (result == EF_NO_ERR) {
+        alloc_sector_map_env(env_addr, env_hdr->len);
+    } else {
+        reload_sector_map(env_addr);
+    }
+#endif
 
-/*
- * The GC will be triggered on the following scene:
- * 1. alloc an ENV when the flash not has enough space
- * 2. write an ENV then the flash not has enough space
- */
-static void gc_collect(void)
-{
-    struct sector_meta_data sector;
-    size_t empty_sec = 0;
+    if (result == EF_NO_ERR) {
+        /* start calculate CRC32, the value CRC32 will be calculated when it's written */
+        env_hdr->crc32 = ef_calc_crc32(0, &env_hdr->name_len, ENV_HDR_DATA_SIZE - ENV_NAME_LEN_OFFSET);
+        env_hdr->crc32 = ef_calc_crc32(env_hdr->crc32, key, env_hdr->name_len);
+        align_remain = EF_WG_ALIGN(env_hdr->name_len) - env_hdr->name_len;
+        while (align_remain--) {
+            env_hdr->crc32 = ef_calc_crc32(env_hdr->crc32, &ff, 1);
+        }
+        env_writer.addr = env_addr;
+        env_writer.written_len = 0;
+        env_writer.window_len = 0;
+        memset(env_writer.name, 0, sizeof(env_writer.name));
+        strncpy(env_writer.name, key, env_hdr->name_len);
+    }
 
-    /* GC check the empty sector number */
-    sector_iterator(&sector, SECTOR_STORE_EMPTY, &empty_sec, NULL, gc_check_cb, false);
+    /* trigger GC collect when current sector is full, the GC will be done when the stream is closed */
+    if (result == EF_NO_ERR && is_full) {
+        EF_DEBUG("Trigger a GC check after created ENV.\n");
+        gc_request = true;
 
-    /* do GC collect */
-    EF_DEBUG("The remain empty sector is %d, GC threshold is %d.\n", empty_sec, EF_GC_EMPTY_SEC_THRESHOLD);
-    if (empty_sec <= EF_GC_EMPTY_SEC_THRESHOLD) {
-        sector_iterator(&sector, SECTOR_STORE_UNUSED, NULL, NULL, do_gc, false);
+#ifdef EF_ENV_USING_HOT_COLD
+        env_hot_decay();
+#endif
     }
 
-    gc_request = false;
+    return result;
 }
 
-static EfErrCode align_write(uint32_t addr, const uint32_t *buf, size_t size)
+static EfErrCode set_env_stream_write(const uint8_t *value, size_t len)
 {
     EfErrCode result = EF_NO_ERR;
-    size_t align_remain;
-
-#if (EF_WRITE_GRAN / 8 > 0)
-    uint8_t align_data[EF_WRITE_GRAN / 8];
-    size_t align_data_size = sizeof(align_data);
-#else
-    /* For compatibility with C89 */
-    uint8_t align_data_u8, *align_data = &align_data_u8;
-    size_t align_data_size = 1;
-#endif
-
-    memset(align_data, 0xFF, align_data_size);
-    align_remain = EF_WG_ALIGN_DOWN(size);//use align_remain temporary to save aligned size.
+    uint32_t value_addr = env_writer.addr + ENV_HDR_DATA_SIZE + EF_WG_ALIGN(env_writer.hdr.name_len);
+    size_t size;
 
-    if(align_remain > 0){//it may be 0 in this function.
-        result = ef_port_write(addr, buf, align_remain);
+    if (env_writer.written_len + env_writer.window_len + len > env_writer.hdr.value_len) {
+        EF_INFO("Error: The written value is more than the ENV (%s) value length.\n", env_writer.name);
+        return EF_WRITE_ERR;
     }
 
-    align_remain = size - align_remain;
-    if (result == EF_NO_ERR && align_remain) {
-        memcpy(align_data, (uint8_t *)buf + EF_WG_ALIGN_DOWN(size), align_remain);
-        result = ef_port_write(addr + EF_WG_ALIGN_DOWN(size), (uint32_t *) align_data, align_data_size);
+    env_writer.hdr.crc32 = ef_calc_crc32(env_writer.hdr.crc32, value, len);
+    while (len > 0 && result == EF_NO_ERR) {
+        if (env_writer.window_len > 0 || len < sizeof(env_writer.window)) {
+            /* fill the window until it's aligned by write granularity */
+            size = sizeof(env_writer.window) - env_writer.window_len;
+            if (size > len) {
+                size = len;
+            }
+            memcpy(env_writer.window + env_writer.window_len, value, size);
+            env_writer.window_len += size;
+            if (env_writer.window_len == sizeof(env_writer.window)) {
+                result = align_write(value_addr + env_writer.written_len, (uint32_t *) env_writer.window,
+                        sizeof(env_writer.window));
+                env_writer.written_len += sizeof(env_writer.window);
+                env_writer.window_len = 0;
+            }
+        } else {
+            /* write the aligned data directly */
+            size = EF_WG_ALIGN_DOWN(len);
+            result = align_write(value_addr + env_writer.written_len, (uint32_t *) value, size);
+            env_writer.written_len += size;
+        }
+        value += size;
+        len -= size;
     }
 
     return result;
 }
 
-static EfErrCode create_env_blob(sector_meta_data_t sector, const char *key, const void *value, size_t len)
+static EfErrCode set_env_stream_close(void)
 {
     EfErrCode result = EF_NO_ERR;
-    struct env_hdr_data env_hdr;
-    bool is_full = false;
-    uint32_t env_addr = sector->empty_env;
+    static struct env_node_obj env;
+    env_hdr_data_t env_hdr = &env_writer.hdr;
+    uint32_t value_addr = env_writer.addr + ENV_HDR_DATA_SIZE + EF_WG_ALIGN(env_hdr->name_len);
+    size_t align_remain;
+    bool env_is_found = false;
+    uint8_t ff = 0xFF;
 
-    if (strlen(key) > EF_ENV_NAME_MAX) {
-        EF_INFO("Error: The ENV name length is more than %d\n", EF_ENV_NAME_MAX);
-        return EF_ENV_NAME_ERR;
+    if (env_writer.written_len + env_writer.window_len != env_hdr->value_len) {
+        EF_INFO("Error: The ENV (%s) value is NOT written completely, it will be discarded.\n", env_writer.name);
+        discard_env_writer();
+        return EF_WRITE_ERR;
     }
 
-    memset(&env_hdr, 0xFF, sizeof(struct env_hdr_data));
-    env_hdr.magic = ENV_MAGIC_WORD;
-    env_hdr.name_len = strlen(key);
-    env_hdr.value_len = len;
-    env_hdr.len = ENV_HDR_DATA_SIZE + EF_WG_ALIGN(env_hdr.name_len) + EF_WG_ALIGN(env_hdr.value_len);
-
-    if (env_hdr.len > SECTOR_SIZE - SECTOR_HDR_DATA_SIZE) {
-        EF_INFO("Error: The ENV size is too big\n");
-        return EF_ENV_FULL;
+    /* write the remain value on window */
+    if (env_writer.window_len > 0) {
+        result = align_write(value_addr + env_writer.written_len, (uint32_t *) env_writer.window,
+                env_writer.window_len);
     }
-
-    if (env_addr != FAILED_ADDR || (env_addr = new_env(sector, env_hdr.len)) != FAILED_ADDR) {
-        size_t align_remain;
-        /* update the sector status */
-        if (result == EF_NO_ERR) {
-            result = update_sec_status(sector, env_hdr.len, &is_full);
-        }
-        if (result == EF_NO_ERR) {
-            uint8_t ff = 0xFF;
-            /* start calculate CRC32 */
-            env_hdr.crc32 = ef_calc_crc32(0, &env_hdr.name_len, ENV_HDR_DATA_SIZE - ENV_NAME_LEN_OFFSET);
-            env_hdr.crc32 = ef_calc_crc32(env_hdr.crc32, key, env_hdr.name_len);
-            align_remain = EF_WG_ALIGN(env_hdr.name_len) - env_hdr.name_len;
-            while (align_remain--) {
-                env_hdr.crc32 = ef_calc_crc32(env_hdr.crc32, &ff, 1);
-            }
-            env_hdr.crc32 = ef_calc_crc32(env_hdr.crc32, value, env_hdr.value_len);
-            align_remain = EF_WG_ALIGN(env_hdr.value_len) - env_hdr.value_len;
-            while (align_remain--) {
-                env_hdr.crc32 = ef_calc_crc32(env_hdr.crc32, &ff, 1);
-            }
-            /* write ENV header data */
-            result = write_env_hdr(env_addr, &env_hdr);
-
+    /* write the CRC32 and other header data */
+    if (result == EF_NO_ERR) {
+        align_remain = EF_WG_ALIGN(env_hdr->value_len) - env_hdr->value_len;
+        while (align_remain--) {
+            env_hdr->crc32 = ef_calc_crc32(env_hdr->crc32, &ff, 1);
         }
-        /* write key name */
-        if (result == EF_NO_ERR) {
-            result = align_write(env_addr + ENV_HDR_DATA_SIZE, (uint32_t *) key, env_hdr.name_len);
+        result = flash_write(env_writer.addr + ENV_CRC32_OFFSET, &env_hdr->crc32,
+                sizeof(struct env_hdr_data) - ENV_CRC32_OFFSET);
+    }
+    if (result != EF_NO_ERR) {
+        discard_env_writer();
+        return result;
+    }
 
-#ifdef EF_ENV_USING_CACHE
-            if (!is_full) {
-                update_sector_cache(sector->addr,
-                        env_addr + ENV_HDR_DATA_SIZE + EF_WG_ALIGN(env_hdr.name_len) + EF_WG_ALIGN(env_hdr.value_len));
-            }
-            update_env_cache(key, env_hdr.name_len, env_addr);
-#endif /* EF_ENV_USING_CACHE */
-        }
-        /* write value */
-        if (result == EF_NO_ERR) {
-            result = align_write(env_addr + ENV_HDR_DATA_SIZE + EF_WG_ALIGN(env_hdr.name_len), value,
-                    env_hdr.value_len);
-        }
-        /* change the ENV status to ENV_WRITE */
-        if (result == EF_NO_ERR) {
-            result = write_status(env_addr, env_hdr.status_table, ENV_STATUS_NUM, ENV_WRITE);
-        }
-        /* trigger GC collect when current sector is full */
-        if (result == EF_NO_ERR && is_full) {
-            EF_DEBUG("Trigger a GC check after created ENV.\n");
-            gc_request = true;
-        }
-    } else {
-        result = EF_ENV_FULL;
+    env_is_found = find_env(env_writer.name, &env);
+    result = commit_env(env_writer.name, env_writer.addr, env_is_found ? &env : NULL);
+    env_writer.addr = FAILED_ADDR;
+    /* process the GC after set ENV */
+    if (gc_request) {
+        gc_collect();
     }
 
     return result;
 }
 
 /**
- * Delete an ENV.
+ * Open a stream to set the blob ENV. The value will be written by ef_set_env_stream_write chunk by chunk,
+ * so the large value is NOT needed to be on RAM. The ENV will be saved when the stream is closed.
+ * @note only one ENV can be written by stream at the same time
  *
  * @param key ENV name
+ * @param value_len the total value length
  *
  * @return result
  */
-EfErrCode ef_del_env(const char *key)
+EfErrCode ef_set_env_stream_open(const char *key, size_t value_len)
 {
     EfErrCode result = EF_NO_ERR;
 
+    EF_ASSERT(key);
+
     if (!init_ok) {
-        EF_INFO("Error: ENV isn't initialize OK.\n");
+        EF_INFO("ENV isn't initialize OK.\n");
         return EF_ENV_INIT_FAILED;
     }
 
+    if (strlen(key) > EF_ENV_NAME_MAX) {
+        EF_INFO("Error: The ENV name length is more than %d\n", EF_ENV_NAME_MAX);
+        return EF_ENV_NAME_ERR;
+    }
+
+    if (env_name_is_reserved(key, strlen(key))) {
+        EF_INFO("Error: The ENV name (%s) is reserved.\n", key);
+        return EF_ENV_NAME_ERR;
+    }
+
+    if (ENV_HDR_DATA_SIZE + EF_WG_ALIGN(strlen(key)) + EF_WG_ALIGN(value_len) > ENV_MAX_SIZE) {
+        EF_INFO("Error: The ENV size is too big\n");
+        return EF_ENV_FULL;
+    }
+
     /* lock the ENV cache */
     ef_port_env_lock();
 
-    result = del_env(key, NULL, true);
+    if (env_writer.addr != FAILED_ADDR) {
+        EF_INFO("Error: The ENV (%s) is writing by stream, please close it first.\n", env_writer.name);
+        result = EF_WRITE_ERR;
+    } else {
+        result = set_env_stream_open(key, value_len);
+    }
 
     /* unlock the ENV cache */
     ef_port_env_unlock();
@@ -1409,80 +4737,55 @@ EfErrCode ef_del_env(const char *key)
 }
 
 /**
- * The same to ef_del_env on this mode
- * It's compatibility with older versions (less then V4.0).
- *
- * @note this function is DEPRECATED
+ * Write the value to the stream which is opened by ef_set_env_stream_open.
+ * The stream will be discarded when write failed.
  *
- * @param key ENV name
+ * @param value_buf value buffer
+ * @param buf_len buffer length
  *
  * @return result
  */
-EfErrCode ef_del_and_save_env(const char *key)
-{
-    return ef_del_env(key);
-}
-
-static EfErrCode set_env(const char *key, const void *value_buf, size_t buf_len)
+EfErrCode ef_set_env_stream_write(const void *value_buf, size_t buf_len)
 {
     EfErrCode result = EF_NO_ERR;
-    static struct env_node_obj env;
-    static struct sector_meta_data sector;
-    bool env_is_found = false;
 
-    if (value_buf == NULL) {
-        result = del_env(key, NULL, true);
-    } else {
-        /* make sure the flash has enough space */
-        if (new_env_by_kv(&sector, strlen(key), buf_len) == FAILED_ADDR) {
-            return EF_ENV_FULL;
-        }
-        env_is_found = find_env(key, &env);
-        /* prepare to delete the old ENV */
-        if (env_is_found) {
-            result = del_env(key, &env, false);
-        }
-        /* create the new ENV */
-        if (result == EF_NO_ERR) {
-            result = create_env_blob(&sector, key, value_buf, buf_len);
-        }
-        /* delete the old ENV */
-        if (env_is_found && result == EF_NO_ERR) {
-            result = del_env(key, &env, true);
-        }
-        /* process the GC after set ENV */
-        if (gc_request) {
-            gc_collect();
-        }
+    EF_ASSERT(value_buf);
+
+    /* lock the ENV cache */
+    ef_port_env_lock();
+
+    if (env_writer.addr == FAILED_ADDR) {
+        EF_INFO("Error: The ENV stream is NOT opened.\n");
+        result = EF_WRITE_ERR;
+    } else if ((result = set_env_stream_write(value_buf, buf_len)) != EF_NO_ERR) {
+        discard_env_writer();
     }
 
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
+
     return result;
 }
 
 /**
- * Set a blob ENV. If it value is NULL, delete it.
- * If not find it in flash, then create it.
- *
- * @param key ENV name
- * @param value ENV value
- * @param len ENV value length
+ * Close the stream and save the ENV. The old ENV will be replaced by the new one.
+ * The ENV will be discarded when its value is NOT written completely.
  *
  * @return result
  */
-EfErrCode ef_set_env_blob(const char *key, const void *value_buf, size_t buf_len)
+EfErrCode ef_set_env_stream_close(void)
 {
     EfErrCode result = EF_NO_ERR;
 
-
-    if (!init_ok) {
-        EF_INFO("ENV isn't initialize OK.\n");
-        return EF_ENV_INIT_FAILED;
-    }
-
     /* lock the ENV cache */
     ef_port_env_lock();
 
-    result = set_env(key, value_buf, buf_len);
+    if (env_writer.addr == FAILED_ADDR) {
+        EF_INFO("Error: The ENV stream is NOT opened.\n");
+        result = EF_WRITE_ERR;
+    } else {
+        result = set_env_stream_close();
+    }
 
     /* unlock the ENV cache */
     ef_port_env_unlock();
@@ -1490,36 +4793,6 @@ EfErrCode ef_set_env_blob(const char *key, const void *value_buf, size_t buf_len
     return result;
 }
 
-/**
- * Set a string ENV. If it value is NULL, delete it.
- * If not find it in flash, then create it.
- *
- * @param key ENV name
- * @param value ENV value
- *
- * @return result
- */
-EfErrCode ef_set_env(const char *key, const char *value)
-{
-    return ef_set_env_blob(key, value, strlen(value));
-}
-
-/**
- * The same to ef_set_env on this mode.
- * It's compatibility with older versions (less then V4.0).
- *
- * @note this function is DEPRECATED
- *
- * @param key ENV name
- * @param value ENV value
- *
- * @return result
- */
-EfErrCode ef_set_and_save_env(const char *key, const char *value)
-{
-    return ef_set_env_blob(key, value, strlen(value));
-}
-
 /**
  * Save ENV to flash.
  *
@@ -1547,6 +4820,8 @@ EfErrCode ef_env_set_default(void)
 
     /* lock the ENV cache */
     ef_port_env_lock();
+    /* the ENV which is writing by stream will be discarded */
+    env_writer.addr = FAILED_ADDR;
     /* format all sectors */
     for (addr = env_start_addr; addr < env_start_addr + ENV_AREA_SIZE; addr += SECTOR_SIZE) {
         result = format_sector(addr, SECTOR_NOT_COMBINED);
@@ -1564,7 +4839,7 @@ EfErrCode ef_env_set_default(void)
             value_len = default_env_set[i].value_len;
         }
         sector.empty_env = FAILED_ADDR;
-        create_env_blob(&sector, default_env_set[i].key, default_env_set[i].value, value_len);
+        create_env_blob(&sector, default_env_set[i].key, default_env_set[i].value, value_len, false, false);
         if (result != EF_NO_ERR) {
             goto __exit;
         }
@@ -1585,11 +4860,17 @@ static bool print_env_cb(env_node_obj_t env, void *arg1, void *arg2)
     if (env->crc_is_ok) {
         /* calculate the total using flash size */
         *using_size += env->len;
-        /* check ENV */
-        if (env->status == ENV_WRITE) {
+        /* check ENV, the batch commit ENV is NOT printed */
+        if (env->status == ENV_WRITE && !env_name_is_reserved(env->name, env->name_len)) {
             ef_print("%.*s=", env->name_len, env->name);
 
-            if (env->value_len < EF_STR_ENV_VALUE_MAX_SIZE ) {
+            if (env_is_counter(env->len, env->name_len, env->value_len)) {
+                uint32_t counter;
+
+                read_env_value(env, 0, &counter, sizeof(uint32_t));
+                ef_print("%lu (counter)", (unsigned long) counter);
+                print_value = true;
+            } else if (env->value_len < EF_STR_ENV_VALUE_MAX_SIZE ) {
                 uint8_t buf[32];
                 size_t len, size;
 __reload:
@@ -1600,7 +4881,7 @@ __reload:
                     } else {
                         size = env->value_len - len;
                     }
-                    ef_port_read(env->addr.value + len, (uint32_t *) buf, EF_WG_ALIGN(size));
+                    read_env_value(env, len, buf, size);
                     if (print_value) {
                         ef_print("%.*s", size, buf);
                     } else if (!ef_is_str(buf, size)) {
@@ -1624,6 +4905,95 @@ __reload:
     return false;
 }
 
+/*
+ * The prefix is checked before the CRC32, so the value of not matched ENV will NOT be read.
+ */
+static bool env_iter_is_match(env_iterator_obj_t itr, env_node_obj_t env)
+{
+    if (env->status != ENV_WRITE || env->name_len < itr->prefix_len
+            || strncmp(env->name, itr->prefix, itr->prefix_len) || env_name_is_reserved(env->name, env->name_len)) {
+        return false;
+    }
+
+    return check_env_crc(env);
+}
+
+/**
+ * Initialize the ENV iterator. The ENV will be got one by one by ef_env_iter_next.
+ *
+ * @param itr iterator
+ * @param prefix only iterate the ENV which name starts with it, NULL: iterate all ENV
+ *
+ * @return the iterator, NULL: ENV isn't initialize OK
+ */
+env_iterator_obj_t ef_env_iter_init(env_iterator_obj_t itr, const char *prefix)
+{
+    EF_ASSERT(itr);
+
+    if (!init_ok) {
+        EF_INFO("ENV isn't initialize OK.\n");
+        /* the iterator has NO ENV */
+        itr->sector_addr = FAILED_ADDR;
+        return NULL;
+    }
+
+    itr->prefix = prefix;
+    itr->prefix_len = prefix ? strlen(prefix) : 0;
+    /* start from the first ENV of first sector */
+    itr->sector_addr = env_start_addr;
+    itr->curr_env.addr.start = FAILED_ADDR;
+
+    return itr;
+}
+
+/**
+ * Get the next ENV by iterator. The current ENV name, value length and value address are on itr->curr_env,
+ * and the value can be read by ef_read_env_value. The ENV maybe missed or duplicated when it's changed in iterating.
+ *
+ * @param itr iterator
+ *
+ * @return false: no more ENV
+ */
+bool ef_env_iter_next(env_iterator_obj_t itr)
+{
+    struct sector_meta_data sector;
+    env_node_obj_t env = &itr->curr_env;
+    bool found = false;
+
+    EF_ASSERT(itr);
+
+    if (!init_ok) {
+        EF_INFO("ENV isn't initialize OK.\n");
+        return false;
+    }
+
+    /* lock the ENV cache */
+    ef_port_env_lock();
+
+    while (!found && itr->sector_addr != FAILED_ADDR) {
+        if (read_sector_meta_data(itr->sector_addr, &sector, false) == EF_NO_ERR
+                && (sector.status.store == SECTOR_STORE_USING || sector.status.store == SECTOR_STORE_FULL)) {
+            /* continue from the current ENV */
+            while ((env->addr.start = get_next_env_addr(&sector, env)) != FAILED_ADDR) {
+                read_env_hdr(env);
+                if (env_iter_is_match(itr, env)) {
+                    found = true;
+                    break;
+                }
+            }
+        }
+        if (!found) {
+            /* the first ENV of next sector */
+            itr->sector_addr = get_next_sector_addr(&sector);
+            env->addr.start = FAILED_ADDR;
+        }
+    }
+
+    /* unlock the ENV cache */
+    ef_port_env_unlock();
+
+    return found;
+}
 
 /**
  * Print ENV.
@@ -1641,7 +5011,7 @@ void ef_print_env(void)
     /* lock the ENV cache */
     ef_port_env_lock();
 
-    env_iterator(&env, &using_size, NULL, print_env_cb);
+    env_iterator(&env, &using_size, NULL, print_env_cb, true);
 
     ef_print("\nmode: next generation\n");
     ef_print("size: %lu/%lu bytes.\n", using_size + (SECTOR_NUM - EF_GC_EMPTY_SEC_THRESHOLD) * SECTOR_HDR_DATA_SIZE,
@@ -1677,7 +5047,8 @@ static void env_auto_update(void)
                         value_len = default_env_set[i].value_len;
                     }
                     sector.empty_env = FAILED_ADDR;
-                    create_env_blob(&sector, default_env_set[i].key, default_env_set[i].value, value_len);
+                    create_env_blob(&sector, default_env_set[i].key, default_env_set[i].value, value_len, false,
+                            false);
                 }
             }
         } else {
@@ -1686,7 +5057,7 @@ static void env_auto_update(void)
         }
     }
 
-    set_env(VER_NUM_ENV_NAME, &setting_ver_num, sizeof(size_t));
+    set_env(VER_NUM_ENV_NAME, &setting_ver_num, sizeof(size_t), false);
 }
 #endif /* EF_ENV_AUTO_UPDATE */
 
@@ -1698,6 +5069,10 @@ static bool check_sec_hdr_cb(sector_meta_data_t sector, void *arg1, void *arg2)
         EF_INFO("Warning: Sector header check failed. Format this sector (0x%08x).\n", sector->addr);
         (*failed_count) ++;
         format_sector(sector->addr, SECTOR_NOT_COMBINED);
+    } else if (sector->combined != SECTOR_NOT_COMBINED && !combined_sector_is_live(sector, true)) {
+        /* the big ENV on combined sector has NOT been written finish or it has been deleted */
+        EF_DEBUG("Format the combined sector (0x%08x) which has no live ENV.\n", sector->addr);
+        format_combined_sector(sector);
     }
 
     return false;
@@ -1715,14 +5090,57 @@ static bool check_and_recovery_gc_cb(sector_meta_data_t sector, void *arg1, void
     return false;
 }
 
+static bool find_pre_write_env_cb(env_node_obj_t env, void *arg1, void *arg2)
+{
+    const char *key = arg1;
+    bool *find_ok = arg2;
+    size_t key_len = strlen(key);
+
+    if (key_len == env->name_len && env->status == ENV_PRE_WRITE && !strncmp(env->name, key, key_len)
+            && check_env_crc(env)) {
+        *find_ok = true;
+        return true;
+    }
+
+    return false;
+}
+
+static bool check_and_recovery_pre_write_cb(env_node_obj_t env, void *arg1, void *arg2)
+{
+    /* the new ENV has been written completely when the old ENV is prepare deleted, @see commit_env */
+    if (env->status == ENV_PRE_DELETE && check_env_crc(env)) {
+        struct env_node_obj pre_write_env;
+        char name[EF_ENV_NAME_MAX + 1] = { 0 };
+        uint8_t status_table[ENV_STATUS_TABLE_SIZE];
+        bool find_ok = false;
+
+        strncpy(name, env->name, env->name_len);
+        env_iterator(&pre_write_env, name, &find_ok, find_pre_write_env_cb, false);
+        if (find_ok) {
+            EF_INFO("Found an ENV (%s) which has changed value but NOT committed. Now will commit it.\n", name);
+            /* the old ENV will be deleted on recovery check */
+            write_status(pre_write_env.addr.start, status_table, ENV_STATUS_NUM, ENV_WRITE);
+        }
+    }
+
+    return false;
+}
+
 static bool check_and_recovery_env_cb(env_node_obj_t env, void *arg1, void *arg2)
 {
     /* recovery the prepare deleted ENV */
     if (env->crc_is_ok && env->status == ENV_PRE_DELETE) {
+        struct sector_meta_data dst;
+
         EF_INFO("Found an ENV (%.*s) which has changed value failed. Now will recovery it.\n", env->name_len, env->name);
         /* recovery the old ENV */
-        if (move_env(env) == EF_NO_ERR) {
+        dst.empty_env = FAILED_ADDR;
+        if (move_env(env, &dst) == EF_NO_ERR) {
             EF_DEBUG("Recovery the ENV successful.\n");
+        } else if (env->len > SECTOR_SIZE - SECTOR_HDR_DATA_SIZE) {
+            /* the GC can NOT make the continuous empty sectors for big ENV, so keep on checking other ENV */
+            EF_INFO("Warning: Moved the big ENV (%.*s) failed when recovery. It will be retried on next load.\n",
+                    env->name_len, env->name);
         } else {
             EF_DEBUG("Warning: Moved an ENV (size %d) failed when recovery. Now will GC then retry.\n", env->len);
             return true;
@@ -1732,7 +5150,19 @@ static bool check_and_recovery_env_cb(env_node_obj_t env, void *arg1, void *arg2
         /* the ENV has not write finish, change the status to error */
         //TODO 쳣״̬װͼ
         write_status(env->addr.start, status_table, ENV_STATUS_NUM, ENV_ERR_HDR);
-        return true;
+        /* keep on checking the following ENV, they maybe need recovery too */
+    }
+
+    if (env->crc_is_ok && env->status == ENV_WRITE) {
+#ifdef EF_ENV_USING_INDEX
+        /* build the index table on this traversal */
+        update_env_index(env->name, env->name_len, env->addr.start);
+#endif
+
+#ifdef EF_ENV_USING_BLOOM
+        /* build the bloom filter on this traversal */
+        env_bloom_add(env->name, env->name_len);
+#endif
     }
 
     return false;
@@ -1751,6 +5181,28 @@ EfErrCode ef_load_env(void)
     size_t check_failed_count = 0;
 
     in_recovery_check = true;
+    gc_step_addr = FAILED_ADDR;
+
+#ifdef EF_ENV_USING_CACHE
+    /* the cached ENV maybe changed by recovery */
+    unverify_env_cache(env_start_addr, ENV_AREA_SIZE);
+#endif
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+    /* the sector map will be rebuilt after recovery */
+    sector_map_ok = false;
+#endif
+
+#ifdef EF_ENV_USING_INDEX
+    /* the index table will be rebuilt on the recovery traversal */
+    env_index_reset();
+#endif
+
+#ifdef EF_ENV_USING_BLOOM
+    /* the bloom filter will be rebuilt on the recovery traversal */
+    env_bloom_reset();
+#endif
+
     /* check all sector header */
     sector_iterator(&sector, SECTOR_STORE_UNUSED, &check_failed_count, NULL, check_sec_hdr_cb, false);
     /* all sector header check failed */
@@ -1761,17 +5213,25 @@ EfErrCode ef_load_env(void)
 
     /* lock the ENV cache */
     ef_port_env_lock();
+    /* finish the committed batch first, the GC will move the batch ENV and the commit ENV will be outdated */
+    recovery_batch();
+    /* commit the new ENV which has been written completely, so the old ENV will NOT be moved */
+    env_iterator(&env, NULL, NULL, check_and_recovery_pre_write_cb, false);
     /* check all sector header for recovery GC */
     sector_iterator(&sector, SECTOR_STORE_UNUSED, NULL, NULL, check_and_recovery_gc_cb, false);
 
 __retry:
     /* check all ENV for recovery */
-    env_iterator(&env, NULL, NULL, check_and_recovery_env_cb);
+    env_iterator(&env, NULL, NULL, check_and_recovery_env_cb, true);
     if (gc_request) {
         gc_collect();
         goto __retry;
     }
 
+#ifdef EF_ENV_USING_SECTOR_MAP
+    sector_map_build();
+#endif
+
     in_recovery_check = false;
 
     /* unlock the ENV cache */
@@ -1791,7 +5251,7 @@ __retry:
 EfErrCode ef_env_init(ef_env const *default_env, size_t default_env_size) {
     EfErrCode result = EF_NO_ERR;
 
-#ifdef EF_ENV_USING_CACHE
+#if defined(EF_ENV_USING_CACHE) || defined(EF_ENV_USING_READ_CACHE)
     size_t i;
 #endif
 
@@ -1817,6 +5277,13 @@ EfErrCode ef_env_init(ef_env const *default_env, size_t default_env_size) {
     }
 #endif /* EF_ENV_USING_CACHE */
 
+#ifdef EF_ENV_USING_READ_CACHE
+    for (i = 0; i < EF_ENV_READ_CACHE_PAGE_NUM; i++) {
+        read_cache_table[i].addr = FAILED_ADDR;
+        read_cache_table[i].last_use = 0;
+    }
+#endif /* EF_ENV_USING_READ_CACHE */
+
     env_start_addr = EF_START_ADDR;
     default_env_set = default_env;
     default_env_set_size = default_env_size;
@@ -1835,6 +5302,24 @@ EfErrCode ef_env_init(ef_env const *default_env, size_t default_env_size) {
         init_ok = true;
     }
 
+#ifdef EF_ENV_USING_INDEX
+    EF_INFO("ENV index table used %d/%d slots, RAM %d bytes.%s\n", env_index_used, EF_ENV_INDEX_TABLE_SIZE,
+            sizeof(env_index_table), env_index_ok ? "" : " It's full, please increase the table size.");
+#endif
+
+#ifdef EF_ENV_USING_BLOOM
+    EF_INFO("ENV bloom filter has %d ENV, %d bits per ENV, %d hash functions, RAM %d bytes.\n",
+            env_bloom_stat.keys, EF_ENV_BLOOM_BITS_PER_KEY, ENV_BLOOM_HASH_NUM, sizeof(env_bloom_table));
+#endif
+
+#ifdef EF_ENV_USING_HOT_COLD
+    EF_INFO("ENV hot table has %d slots, RAM %d bytes.\n", EF_ENV_HOT_TABLE_SIZE, sizeof(env_hot_table));
+#endif
+
+#ifdef EF_ENV_USING_SECTOR_MAP
+    EF_INFO("ENV sector map has %d sectors, RAM %d bytes.\n", SECTOR_NUM, sizeof(sector_map_table));
+#endif
+
     return result;
 }
 
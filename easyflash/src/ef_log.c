@@ -26,6 +26,7 @@
  * Created on: 2015-06-04
  */
 
+#include <string.h>
 #include <easyflash.h>
 
 #ifdef EF_USING_LOG
@@ -34,26 +35,81 @@
 #error "Please configure log area size (in ef_cfg.h)"
 #endif
 
-/* magic code on every sector header. 'EF' is 0xEF30EF30 */
-#define LOG_SECTOR_MAGIC               0xEF30EF30
-/* sector header size, includes the sector magic code and status magic code */
-#define LOG_SECTOR_HEADER_SIZE         12
+#ifdef EF_LOG_WRITE_BUF_SIZE
+#if (EF_LOG_WRITE_BUF_SIZE & (EF_LOG_WRITE_BUF_SIZE - 1)) != 0 || EF_LOG_WRITE_BUF_SIZE <= 16
+#error "the log write buffer size (EF_LOG_WRITE_BUF_SIZE) must be a power of 2 and greater than 16"
+#endif
+#if defined(EF_LOG_WRITE_BUF_LATENCY) && !defined(EF_LOG_GET_TICK)
+#error "Please configure the tick get function EF_LOG_GET_TICK() for the log write buffer latency (in ef_cfg.h)"
+#endif
+#endif /* EF_LOG_WRITE_BUF_SIZE */
+
+#ifdef EF_LOG_USING_RECORD
+/**
+ * The record frame on log. The records are packed by word alignment.
+ * ==========================================================================
+ * | magic(2B) len(2B) | sequence num(4B) | CRC32(4B) | data | magic(2B) len(2B) |
+ * ==========================================================================
+ * The CRC32 is calculated on magic, len, sequence number and data. The data is padded by 0 to word alignment.
+ * The tail is same as the first word, so the record can be found backward.
+ */
+#define LOG_RECORD_MAGIC               0xEF4C
+#define LOG_RECORD_HDR_SIZE            12
+#define LOG_RECORD_TAIL_SIZE           4
+#define LOG_RECORD_DATA_MAX            0xFFFF
+#define LOG_RECORD_SIZE(len)           (LOG_RECORD_HDR_SIZE + ((len) + 3) / 4 * 4 + LOG_RECORD_TAIL_SIZE)
+/* the newest record must end within one torn record of the log tail, so the backward search on init is limited */
+#define LOG_RECORD_RECOVER_SIZE        (2 * LOG_RECORD_SIZE(LOG_RECORD_DATA_MAX))
+/* the buffer word size of record write, read and scan */
+#define LOG_RECORD_BUF_WORDS           8
+#endif /* EF_LOG_USING_RECORD */
+
+/* the pre-erased sector number after the USING sector, @see ef_log_pre_erase */
+#ifndef EF_LOG_PRE_ERASE_SEC_NUM
+#define EF_LOG_PRE_ERASE_SEC_NUM                 1
+#endif
+
+#ifdef EF_LOG_RING_SIZE
+#if (EF_LOG_RING_SIZE & (EF_LOG_RING_SIZE - 1)) != 0 || EF_LOG_RING_SIZE < 8
+#error "the log ring size (EF_LOG_RING_SIZE) must be a power of 2 and greater than or equal to 8"
+#endif
+/* atomic compare and swap, it returns true when the *ptr is old and it has been changed to new */
+#ifndef EF_LOG_ATOMIC_CAS
+#define EF_LOG_ATOMIC_CAS(ptr, old, new)         __sync_bool_compare_and_swap(ptr, old, new)
+#endif
+/* full memory barrier */
+#ifndef EF_LOG_MEMORY_BARRIER
+#define EF_LOG_MEMORY_BARRIER()                  __sync_synchronize()
+#endif
+/* every record on log ring has a 4 bytes header, the header is 0 until the record is committed */
+#define LOG_RING_HDR_SIZE              4
+#define LOG_RING_HDR_COMMITTED         0x80000000
+#define LOG_RING_WORD_MASK             (EF_LOG_RING_SIZE / 4 - 1)
+#endif /* EF_LOG_RING_SIZE */
+
+/* magic code on every sector header. 'EF' is 0xEF31EF31, the old header (0xEF30EF30) has no sequence number */
+#define LOG_SECTOR_MAGIC               0xEF31EF31
+/* sector header size, includes the sector magic code, status magic code and sequence number */
+#define LOG_SECTOR_HEADER_SIZE         16
 /* sector header word size,what is equivalent to the total number of sectors header index */
-#define LOG_SECTOR_HEADER_WORD_SIZE    3
+#define LOG_SECTOR_HEADER_WORD_SIZE    4
 
 /**
  * Sector status magic code
  * The sector status is 8B after LOG_SECTOR_MAGIC at every sector header.
- * ==============================================
- * |           header(12B)            | status |
- * ----------------------------------------------
- * | 0xEF30EF30 0xFFFFFFFF 0xFFFFFFFF |  empty |
- * | 0xEF30EF30 0xFEFEFEFE 0xFFFFFFFF |  using |
- * | 0xEF30EF30 0xFEFEFEFE 0xFCFCFCFC |  full  |
- * ==============================================
+ * ===========================================================
+ * |                     header(16B)                | status |
+ * -----------------------------------------------------------
+ * | 0xEF31EF31 0xFFFFFFFF 0xFFFFFFFF   0xFFFFFFFF  |  empty |
+ * | 0xEF31EF31 0xFEFEFEFE 0xFFFFFFFF  sequence num |  using |
+ * | 0xEF31EF31 0xFEFEFEFE 0xFCFCFCFC  sequence num |  full  |
+ * ===========================================================
  *
  * State transition relationship: empty->using->full
  * The FULL status will change to EMPTY after sector clean.
+ *
+ * The sequence number is written before the USING status. It's increased by 1 for every new USING sector,
+ * so the sequence numbers are continuous from the first sector to the USING sector.
  */
 #define SECTOR_STATUS_MAGIC_EMPUT     0xFFFFFFFF
 #define SECTOR_STATUS_MAGIC_USING     0xFEFEFEFE
@@ -70,17 +126,53 @@ typedef enum {
     SECTOR_HEADER_MAGIC_INDEX,
     SECTOR_HEADER_USING_INDEX,
     SECTOR_HEADER_FULL_INDEX,
+    SECTOR_HEADER_SEQ_INDEX,
 } SectorHeaderIndex;
 
 /* the stored logs start address and end address. It's like a ring buffer implemented on flash. */
 static uint32_t log_start_addr = 0, log_end_addr = 0;
 /* saved log area address for flash */
 static uint32_t log_area_start_addr = 0;
+/* the sequence number of current USING sector */
+static uint32_t log_sec_seq = 0;
 /* initialize OK flag */
 static bool init_ok = false;
 
+#ifdef EF_LOG_WRITE_BUF_SIZE
+/* the log staging buffer, it's the tail of stored logs which is NOT written to flash */
+static uint32_t log_buf[EF_LOG_WRITE_BUF_SIZE / 4];
+/* the log staging buffer used length */
+static size_t log_buf_len = 0;
+#ifdef EF_LOG_WRITE_BUF_LATENCY
+/* the tick when the first log is put into the empty staging buffer */
+static uint32_t log_buf_tick = 0;
+#endif
+#endif /* EF_LOG_WRITE_BUF_SIZE */
+
+#ifdef EF_LOG_RING_SIZE
+/**
+ * The multi-producer single-consumer log ring. It's ISR safe and lock-free.
+ * The head and tail are free running byte counters, the ring position is (counter % EF_LOG_RING_SIZE).
+ * The producers reserve the space by moving the head, and commit the record by writing its header.
+ * The consumer (ef_log_ring_drain) writes the committed records to flash in order, then moves the tail.
+ */
+static uint32_t log_ring[EF_LOG_RING_SIZE / 4];
+static volatile uint32_t log_ring_head = 0, log_ring_tail = 0;
+static volatile uint32_t log_ring_high_water = 0, log_ring_dropped = 0, log_ring_dropped_bytes = 0;
+#endif /* EF_LOG_RING_SIZE */
+
+#ifdef EF_LOG_USING_RECORD
+/* the sequence number of next record */
+static uint32_t log_record_seq = 0;
+#endif
+
 static void find_start_and_end_addr(void);
+static EfErrCode open_next_sector(uint32_t *write_addr);
 static uint32_t get_next_flash_sec_addr(uint32_t cur_addr);
+static uint32_t get_offset_flash_sec_addr(uint32_t cur_addr, size_t offset);
+#ifdef EF_LOG_USING_RECORD
+static bool log_record_find_prev(size_t index, size_t min_index, size_t used_size, log_iterator_obj_t itr);
+#endif
 
 /**
  * The flash save log function initialize.
@@ -96,6 +188,12 @@ EfErrCode ef_log_init(void) {
     EF_ASSERT(LOG_AREA_SIZE % EF_ERASE_MIN_SIZE == 0);
     /* the log area size must be more than twice of EF_ERASE_MIN_SIZE */
     EF_ASSERT(LOG_AREA_SIZE / EF_ERASE_MIN_SIZE >= 2);
+    /* one sector at least has log */
+    EF_ASSERT(EF_LOG_PRE_ERASE_SEC_NUM < LOG_AREA_SIZE / EF_ERASE_MIN_SIZE);
+#ifdef EF_LOG_WRITE_BUF_SIZE
+    /* the staging buffer is flushed by page, the page must be in one sector */
+    EF_ASSERT(EF_LOG_WRITE_BUF_SIZE <= EF_ERASE_MIN_SIZE);
+#endif
 
 #ifdef EF_USING_ENV
     log_area_start_addr = EF_START_ADDR + ENV_AREA_SIZE;
@@ -103,22 +201,38 @@ EfErrCode ef_log_init(void) {
     log_area_start_addr = EF_START_ADDR;
 #endif
 
+    /* the logs on staging buffer before initialize are dropped */
+#ifdef EF_LOG_WRITE_BUF_SIZE
+    log_buf_len = 0;
+#endif
     /* find the log store start address and end address */
     find_start_and_end_addr();
     /* initialize OK */
     init_ok = true;
 
+#ifdef EF_LOG_USING_RECORD
+    {
+        struct log_iterator_obj itr;
+        size_t used_size = ef_log_get_used_size();
+        size_t min_index = used_size > LOG_RECORD_RECOVER_SIZE ? used_size - LOG_RECORD_RECOVER_SIZE : 0;
+        /* the next record sequence number is after the newest record, it restarts at 0 when NOT found */
+        ef_log_iter_init(&itr, true);
+        log_record_seq = log_record_find_prev(used_size, min_index, used_size, &itr) ? itr.seq + 1 : 0;
+    }
+#endif
+
     return result;
 }
 
 /**
- * Get flash sector current status.
+ * Get flash sector current status and sequence number.
  *
  * @param addr sector address, this function will auto calculate the sector header address by this address.
+ * @param seq the sector sequence number, it's only valid when the sector status is USING or FULL
  *
  * @return the flash sector current status
  */
-static SectorStatus get_sector_status(uint32_t addr) {
+static SectorStatus get_sector_info(uint32_t addr, uint32_t *seq) {
     uint32_t header_buf[LOG_SECTOR_HEADER_WORD_SIZE] = {0}, header_addr = 0;
     uint32_t sector_header_magic = 0;
     uint32_t status_full_magic = 0, status_use_magic = 0;
@@ -130,6 +244,7 @@ static SectorStatus get_sector_status(uint32_t addr) {
         sector_header_magic = header_buf[SECTOR_HEADER_MAGIC_INDEX];
         status_use_magic = header_buf[SECTOR_HEADER_USING_INDEX];
         status_full_magic = header_buf[SECTOR_HEADER_FULL_INDEX];
+        *seq = header_buf[SECTOR_HEADER_SEQ_INDEX];
     } else {
         EF_DEBUG("Error: Read sector header data error.\n");
         return SECTOR_STATUS_HEADER_ERROR;
@@ -152,6 +267,33 @@ static SectorStatus get_sector_status(uint32_t addr) {
 
 }
 
+/**
+ * Get flash sector current status.
+ *
+ * @param addr sector address, this function will auto calculate the sector header address by this address.
+ *
+ * @return the flash sector current status
+ */
+static SectorStatus get_sector_status(uint32_t addr) {
+    uint32_t seq;
+
+    return get_sector_info(addr, &seq);
+}
+
+/**
+ * Write flash sector sequence number. It must be written before the USING status.
+ *
+ * @param addr sector address, this function will auto calculate the sector header address by this address.
+ * @param seq sector sequence number
+ *
+ * @return result
+ */
+static EfErrCode write_sector_seq(uint32_t addr, uint32_t seq) {
+    uint32_t header_addr = addr & (~(EF_ERASE_MIN_SIZE - 1));
+
+    return ef_port_write(header_addr + SECTOR_HEADER_SEQ_INDEX * sizeof(uint32_t), &seq, sizeof(seq));
+}
+
 /**
  * Write flash sector current status.
  *
@@ -185,57 +327,91 @@ static EfErrCode write_sector_status(uint32_t addr, SectorStatus status) {
     }
 }
 
+/**
+ * Check the log data block is erased (all 0xFF).
+ *
+ * @param addr block address
+ * @param buf read buffer
+ * @param size block size
+ *
+ * @return true: the block is erased
+ */
+static bool log_block_is_erased(uint32_t addr, uint8_t *buf, size_t size) {
+    size_t i;
+
+    ef_port_read(addr, (uint32_t *)buf, size);
+    for (i = 0; i < size; i++) {
+        if (buf[i] != 0xFF) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 /**
  * Find the current flash sector using end address by continuous 0xFF.
+ * The log is written sequentially, so the first erased block is found by binary search. The log data maybe has the
+ * block size continuous 0xFF, so all blocks after the found block must be erased, or it's searched again after them.
  *
  * @param addr sector address
  *
  * @return current flash sector using end address
  */
 static uint32_t find_sec_using_end_addr(uint32_t addr) {
-/* read section data buffer size */
+/* read section data buffer size, it's the binary search block size too */
 #define READ_BUF_SIZE                32
 
-    uint32_t sector_start = addr, data_start = addr, continue_ff = 0, read_buf_size = 0, i;
+    uint32_t sector_start, data_start, data_end, block_addr;
+    size_t low, high, mid, block_num, read_buf_size, i;
     uint8_t buf[READ_BUF_SIZE];
 
     EF_ASSERT(READ_BUF_SIZE % 4 == 0);
     /* calculate the sector start and data start address */
     sector_start = addr & (~(EF_ERASE_MIN_SIZE - 1));
     data_start = sector_start + LOG_SECTOR_HEADER_SIZE;
+    data_end = sector_start + EF_ERASE_MIN_SIZE;
+    block_num = (data_end - data_start + READ_BUF_SIZE - 1) / READ_BUF_SIZE;
 
-    /* counts continuous 0xFF which is end of sector */
-    while (data_start < sector_start + EF_ERASE_MIN_SIZE) {
-        if (data_start + READ_BUF_SIZE < sector_start + EF_ERASE_MIN_SIZE) {
-            read_buf_size = READ_BUF_SIZE;
-        } else {
-            read_buf_size = sector_start + EF_ERASE_MIN_SIZE - data_start;
-        }
-        ef_port_read(data_start, (uint32_t *)buf, read_buf_size);
-        for (i = 0; i < read_buf_size; i++) {
-            if (buf[i] == 0xFF) {
-                continue_ff++;
+    low = 0;
+    while (true) {
+        /* binary search the first erased block */
+        high = block_num;
+        while (low < high) {
+            mid = (low + high) / 2;
+            block_addr = data_start + mid * READ_BUF_SIZE;
+            read_buf_size = data_end - block_addr < READ_BUF_SIZE ? data_end - block_addr : READ_BUF_SIZE;
+            if (log_block_is_erased(block_addr, buf, read_buf_size)) {
+                high = mid;
             } else {
-                continue_ff = 0;
+                low = mid + 1;
+            }
+        }
+        /* check all blocks after it are erased */
+        for (mid = low + 1; mid < block_num; mid++) {
+            block_addr = data_start + mid * READ_BUF_SIZE;
+            read_buf_size = data_end - block_addr < READ_BUF_SIZE ? data_end - block_addr : READ_BUF_SIZE;
+            if (!log_block_is_erased(block_addr, buf, read_buf_size)) {
+                break;
             }
         }
-        data_start += read_buf_size;
+        if (mid >= block_num) {
+            break;
+        }
+        /* the found block is the continuous 0xFF on log data, search again after the not erased block */
+        low = mid + 1;
     }
-    /* calculate current flash sector using end address */
-    if (continue_ff >= EF_ERASE_MIN_SIZE - LOG_SECTOR_HEADER_SIZE) {
+    if (low == 0) {
         /* from 0 to sec_size all sector is 0xFF, so the sector is empty */
-        return sector_start + LOG_SECTOR_HEADER_SIZE;
-    } else if (continue_ff >= 4) {
-        /* form end_addr - 4 to sec_size length all area is 0xFF, so it's used part of the sector.
-         * the address must be word alignment. */
-        if (continue_ff % 4 != 0) {
-            continue_ff = (continue_ff / 4 + 1) * 4;
-        }
-        return sector_start + EF_ERASE_MIN_SIZE - continue_ff;
-    } else {
-        /* all sector not has continuous 0xFF, so the sector is full */
-        return sector_start + EF_ERASE_MIN_SIZE;
+        return data_start;
     }
+    /* the end is in the last not erased block, the address must be word alignment */
+    block_addr = data_start + (low - 1) * READ_BUF_SIZE;
+    read_buf_size = data_end - block_addr < READ_BUF_SIZE ? data_end - block_addr : READ_BUF_SIZE;
+    ef_port_read(block_addr, (uint32_t *)buf, read_buf_size);
+    for (i = read_buf_size; i > 0 && buf[i - 1] == 0xFF; i--);
+
+    return block_addr + (i + 3) / 4 * 4;
 }
 
 /**
@@ -262,129 +438,92 @@ static uint32_t find_sec_using_end_addr(uint32_t addr) {
  *
  */
 static void find_start_and_end_addr(void) {
-    size_t cur_size = 0;
-    SectorStatus cur_sec_status, last_sec_status;
-    uint32_t cur_using_sec_addr = 0;
-    /* all status sector counts */
-    size_t empty_sec_counts = 0, using_sec_counts = 0, full_sector_counts = 0;
+    EfErrCode result = EF_NO_ERR;
+    SectorStatus sec_status, using_sec_status;
+    uint32_t first_seq = 0, seq = 0, first_sec_addr = log_area_start_addr, using_sec_addr;
     /* total sector number */
-    size_t total_sec_num = LOG_AREA_SIZE / EF_ERASE_MIN_SIZE;
-    /* see comment of find_start_and_end_addr function */
-    uint8_t cur_log_sec_state = 0;
-
-    /* get the first sector status */
-    cur_sec_status = get_sector_status(log_area_start_addr);
-    last_sec_status = cur_sec_status;
-
-    for (cur_size = EF_ERASE_MIN_SIZE; cur_size < LOG_AREA_SIZE; cur_size += EF_ERASE_MIN_SIZE) {
-        /* get current sector status */
-        cur_sec_status = get_sector_status(log_area_start_addr + cur_size);
-        /* compare last and current status */
-        switch (last_sec_status) {
-        case SECTOR_STATUS_EMPUT: {
-            switch (cur_sec_status) {
-            case SECTOR_STATUS_EMPUT:
-                break;
-            case SECTOR_STATUS_USING:
-                EF_DEBUG("Error: Log area error! Now will clean all log area.\n");
-                ef_log_clean();
-                return;
-            case SECTOR_STATUS_FULL:
-                EF_DEBUG("Error: Log area error! Now will clean all log area.\n");
-                ef_log_clean();
-                return;
-            }
-            empty_sec_counts++;
-            break;
-        }
-        case SECTOR_STATUS_USING: {
-            switch (cur_sec_status) {
-            case SECTOR_STATUS_EMPUT:
-                /* like state 1 */
-                cur_log_sec_state = 1;
-                log_start_addr = log_area_start_addr;
-                cur_using_sec_addr = log_area_start_addr + cur_size - EF_ERASE_MIN_SIZE;
-                break;
-            case SECTOR_STATUS_USING:
-                EF_DEBUG("Error: Log area error! Now will clean all log area.\n");
-                ef_log_clean();
-                return;
-            case SECTOR_STATUS_FULL:
-                /* like state 2 */
-                cur_log_sec_state = 2;
-                log_start_addr = log_area_start_addr + cur_size;
-                cur_using_sec_addr = log_area_start_addr + cur_size - EF_ERASE_MIN_SIZE;
-                break;
-            }
-            using_sec_counts++;
-            break;
-        }
-        case SECTOR_STATUS_FULL: {
-            switch (cur_sec_status) {
-            case SECTOR_STATUS_EMPUT:
-                /* like state 1 */
-                if (cur_log_sec_state == 2) {
-                    EF_DEBUG("Error: Log area error! Now will clean all log area.\n");
-                    ef_log_clean();
-                    return;
-                } else {
-                    cur_log_sec_state = 1;
-                    log_start_addr = log_area_start_addr;
-                    log_end_addr = log_area_start_addr + cur_size;
-                    cur_using_sec_addr = log_area_start_addr + cur_size - EF_ERASE_MIN_SIZE;
-                }
-                break;
-            case SECTOR_STATUS_USING:
-                if(total_sec_num <= 2) {
-                    /* like state 1 */
-                    cur_log_sec_state = 1;
-                    log_start_addr = log_area_start_addr;
-                    cur_using_sec_addr = log_area_start_addr + cur_size;
-                } else {
-                    /* like state 2 when the sector is the last one */
-                    if (cur_size + EF_ERASE_MIN_SIZE >= LOG_AREA_SIZE) {
-                        cur_log_sec_state = 2;
-                        log_start_addr = get_next_flash_sec_addr(log_area_start_addr + cur_size);
-                        cur_using_sec_addr = log_area_start_addr + cur_size;
-                    }
-                }
-                break;
-            case SECTOR_STATUS_FULL:
-                break;
-            }
-            full_sector_counts++;
-            break;
-        }
-        case SECTOR_STATUS_HEADER_ERROR:
-            EF_DEBUG("Error: Log sector header error! Now will clean all log area.\n");
-            ef_log_clean();
-            return;
-        }
-        last_sec_status = cur_sec_status;
-    }
+    size_t total_sec_num = LOG_AREA_SIZE / EF_ERASE_MIN_SIZE, low, high, mid, i;
 
-    /* the last sector status counts */
-    if (cur_sec_status == SECTOR_STATUS_EMPUT) {
-        empty_sec_counts++;
-    } else if (cur_sec_status == SECTOR_STATUS_USING) {
-        using_sec_counts++;
-    } else if (cur_sec_status == SECTOR_STATUS_FULL) {
-        full_sector_counts++;
-    } else if (cur_sec_status == SECTOR_STATUS_HEADER_ERROR) {
+    /* the first sector always has log in both states, except it's pre-erased, @see ef_log_pre_erase */
+    sec_status = get_sector_info(first_sec_addr, &first_seq);
+    if (sec_status == SECTOR_STATUS_EMPUT) {
+        /* the sector behind the pre-erased sectors has log */
+        first_sec_addr = get_offset_flash_sec_addr(log_area_start_addr, EF_LOG_PRE_ERASE_SEC_NUM);
+        sec_status = get_sector_info(first_sec_addr, &first_seq);
+    }
+    for (i = 1; i < total_sec_num && sec_status == SECTOR_STATUS_EMPUT; i++) {
+        /* this state is almost impossible, find the sector which has log one by one */
+        first_sec_addr = get_offset_flash_sec_addr(log_area_start_addr, i);
+        sec_status = get_sector_info(first_sec_addr, &first_seq);
+    }
+    if (sec_status != SECTOR_STATUS_USING && sec_status != SECTOR_STATUS_FULL) {
         EF_DEBUG("Error: Log sector header error! Now will clean all log area.\n");
         ef_log_clean();
         return;
     }
-
-    if (using_sec_counts != 1) {
+    /* the sequence numbers are continuous from the found sector to the USING sector, so binary search the USING
+     * sector. The sectors after it are EMPTY (state 1 or pre-erased) or have the older sequence numbers (state 2). */
+    low = 0;
+    high = total_sec_num - 1;
+    while (low < high) {
+        mid = (low + high + 1) / 2;
+        sec_status = get_sector_info(get_offset_flash_sec_addr(first_sec_addr, mid), &seq);
+        if (sec_status == SECTOR_STATUS_HEADER_ERROR) {
+            EF_DEBUG("Error: Log sector header error! Now will clean all log area.\n");
+            ef_log_clean();
+            return;
+        }
+        if (sec_status != SECTOR_STATUS_EMPUT && seq - first_seq == mid) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    using_sec_addr = get_offset_flash_sec_addr(first_sec_addr, low);
+    using_sec_status = get_sector_info(using_sec_addr, &log_sec_seq);
+    if (using_sec_status != SECTOR_STATUS_USING && using_sec_status != SECTOR_STATUS_FULL) {
         /* this state is almost impossible */
         EF_DEBUG("Error: There must be only one sector status is USING! Now will clean all log area.\n");
         ef_log_clean();
-    } else {
+        return;
+    }
+    /* the EMPTY sectors are continuous after the USING sector, so binary search the first sector which has log
+     * after them, it's the start sector. It's the first sector (state 1) or the next sector of USING (state 2). */
+    low = 1;
+    high = total_sec_num;
+    while (low < high) {
+        mid = (low + high) / 2;
+        sec_status = get_sector_status(get_offset_flash_sec_addr(using_sec_addr, mid));
+        if (sec_status == SECTOR_STATUS_HEADER_ERROR) {
+            EF_DEBUG("Error: Log sector header error! Now will clean all log area.\n");
+            ef_log_clean();
+            return;
+        }
+        if (sec_status == SECTOR_STATUS_EMPUT) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    log_start_addr = get_offset_flash_sec_addr(using_sec_addr, low);
+    if (using_sec_status == SECTOR_STATUS_USING) {
         /* find the end address */
-        log_end_addr = find_sec_using_end_addr(cur_using_sec_addr);
+        log_end_addr = find_sec_using_end_addr(using_sec_addr);
+        if (log_end_addr != using_sec_addr + EF_ERASE_MIN_SIZE) {
+            return;
+        }
+        /* the power is down after the sector is filled up and before the FULL status is written */
+        result = write_sector_status(using_sec_addr, SECTOR_STATUS_FULL);
+    }
+    /* the next sector is NOT opened when the power is down or write failed on switching sector, open it now */
+    log_end_addr = using_sec_addr + EF_ERASE_MIN_SIZE;
+    if (result == EF_NO_ERR) {
+        result = open_next_sector(&log_end_addr);
+    }
+    if (result != EF_NO_ERR) {
+        EF_DEBUG("Error: Open the next log sector failed! Now will clean all log area.\n");
+        ef_log_clean();
     }
-
 }
 
 /**
@@ -407,7 +546,12 @@ size_t ef_log_get_used_size(void) {
 
     header_total_num = physical_size / EF_ERASE_MIN_SIZE + 1;
 
+#ifdef EF_LOG_WRITE_BUF_SIZE
+    /* the logs on staging buffer is the tail of stored logs */
+    return physical_size - header_total_num * LOG_SECTOR_HEADER_SIZE + log_buf_len;
+#else
     return physical_size - header_total_num * LOG_SECTOR_HEADER_SIZE;
+#endif
 }
 
 /**
@@ -441,12 +585,16 @@ static EfErrCode log_seq_read(uint32_t addr, uint32_t *log, size_t size) {
     size_t read_size = 0, read_size_temp = 0;
 
     while (size) {
+        /* the log area is a ring, return to ring head */
+        if (addr + read_size >= log_area_start_addr + LOG_AREA_SIZE) {
+            addr -= LOG_AREA_SIZE;
+        }
         /* move to sector data address */
         if ((addr + read_size) % EF_ERASE_MIN_SIZE == 0) {
             addr += LOG_SECTOR_HEADER_SIZE;
         }
         /* calculate current sector last data size */
-        read_size_temp = EF_ERASE_MIN_SIZE - (addr % EF_ERASE_MIN_SIZE);
+        read_size_temp = EF_ERASE_MIN_SIZE - ((addr + read_size) % EF_ERASE_MIN_SIZE);
         if (size < read_size_temp) {
             read_size_temp = size;
         }
@@ -526,6 +674,24 @@ EfErrCode ef_log_read(size_t index, uint32_t *log, size_t size) {
         return EF_ENV_INIT_FAILED;
     }
 
+#ifdef EF_LOG_WRITE_BUF_SIZE
+    if (index + size > cur_using_size - log_buf_len) {
+        /* the read end is on staging buffer, copy the tail from it */
+        size_t flash_size = cur_using_size - log_buf_len, buf_index = 0;
+
+        if (index > flash_size) {
+            buf_index = index - flash_size;
+        }
+        read_size_temp = index + size - (index > flash_size ? index : flash_size);
+        memcpy((uint8_t *)log + size - read_size_temp, (uint8_t *)log_buf + buf_index, read_size_temp);
+        size -= read_size_temp;
+        read_size_temp = 0;
+        if (!size) {
+            return result;
+        }
+    }
+#endif /* EF_LOG_WRITE_BUF_SIZE */
+
     if (log_start_addr < log_end_addr) {
         log_seq_read(log_index2addr(index), log, size);
     } else {
@@ -600,27 +766,69 @@ EfErrCode ef_log_read(size_t index, uint32_t *log, size_t size) {
 }
 
 /**
- * Write log to flash.
+ * Open the next sector of current sector to write log, the next sector will be erased when it's NOT pre-erased.
+ *
+ * @param write_addr the current write address, it will be the next sector log start address when open OK
+ *
+ * @return result
+ */
+static EfErrCode open_next_sector(uint32_t *write_addr) {
+    EfErrCode result = EF_NO_ERR;
+    uint32_t sec_addr, seq;
+
+    /* calculate next available sector address */
+    sec_addr = get_next_flash_sec_addr(*write_addr - 4);
+    /* move the flash log start address to next available sector address */
+    if (log_start_addr == sec_addr) {
+        log_start_addr = get_next_flash_sec_addr(log_start_addr);
+    }
+    /* the EMPTY sector which has NOT sequence number has been erased, such as pre-erased by ef_log_pre_erase */
+    if (get_sector_info(sec_addr, &seq) != SECTOR_STATUS_EMPUT || seq != 0xFFFFFFFF) {
+        /* erase sector */
+        result = ef_port_erase(sec_addr, EF_ERASE_MIN_SIZE);
+        if (result == EF_NO_ERR) {
+            result = write_sector_status(sec_addr, SECTOR_STATUS_EMPUT);
+        }
+        if (result != EF_NO_ERR) {
+            return result;
+        }
+    }
+    /* the sequence number must be written before the USING status, @see find_start_and_end_addr */
+    result = write_sector_seq(sec_addr, log_sec_seq + 1);
+    if (result != EF_NO_ERR) {
+        return result;
+    }
+    /* change the sector status to USING when write begin sector start address */
+    result = write_sector_status(sec_addr, SECTOR_STATUS_USING);
+    if (result == EF_NO_ERR) {
+        log_sec_seq++;
+        *write_addr = sec_addr + LOG_SECTOR_HEADER_SIZE;
+    }
+
+    return result;
+}
+
+/**
+ * Write log to flash directly.
  *
  * @param log the log which will be write to flash
  * @param size write bytes size
+ * @param written the actually written bytes size, it's less than the write size when failed. It can be NULL.
  *
  * @return result
  */
-EfErrCode ef_log_write(const uint32_t *log, size_t size) {
+static EfErrCode log_write(const uint32_t *log, size_t size, size_t *written) {
     EfErrCode result = EF_NO_ERR;
     size_t write_size = 0, writable_size = 0;
-    uint32_t write_addr = log_end_addr, erase_addr;
+    uint32_t write_addr = log_end_addr;
     SectorStatus sector_status;
 
-    EF_ASSERT(size % 4 == 0);
-    /* must be call this function after initialize OK */
-    if (!init_ok) {
-        return EF_ENV_INIT_FAILED;
-    }
-
-    if ((sector_status = get_sector_status(write_addr)) == SECTOR_STATUS_HEADER_ERROR) {
-        return EF_WRITE_ERR;
+    if ((write_addr - log_area_start_addr) % EF_ERASE_MIN_SIZE == 0) {
+        /* the current sector is full, the log will NOT be written on the next sector header */
+        sector_status = SECTOR_STATUS_FULL;
+    } else if ((sector_status = get_sector_status(write_addr)) == SECTOR_STATUS_HEADER_ERROR) {
+        result = EF_WRITE_ERR;
+        goto exit;
     }
     /* write some log when current sector status is USING and EMPTY */
     if ((sector_status == SECTOR_STATUS_USING) || (sector_status == SECTOR_STATUS_EMPUT)) {
@@ -631,39 +839,29 @@ EfErrCode ef_log_write(const uint32_t *log, size_t size) {
             if (result != EF_NO_ERR) {
                 goto exit;
             }
+            log_end_addr = write_addr + writable_size;
+            write_size += writable_size;
             /* change the current sector status to FULL */
             result = write_sector_status(write_addr, SECTOR_STATUS_FULL);
             if (result != EF_NO_ERR) {
                 goto exit;
             }
-            write_size += writable_size;
         } else {
             result = ef_port_write(write_addr, log, size);
-            log_end_addr = write_addr + size;
+            if (result == EF_NO_ERR) {
+                log_end_addr = write_addr + size;
+                write_size += size;
+            }
             goto exit;
         }
     }
     /* erase and write remain log */
     while (true) {
-        /* calculate next available sector address */
-        erase_addr = write_addr = get_next_flash_sec_addr(write_addr - 4);
-        /* move the flash log start address to next available sector address */
-        if (log_start_addr == erase_addr) {
-            log_start_addr = get_next_flash_sec_addr(log_start_addr);
-        }
-        /* erase sector */
-        result = ef_port_erase(erase_addr, EF_ERASE_MIN_SIZE);
+        result = open_next_sector(&write_addr);
         if (result != EF_NO_ERR) {
             goto exit;
         }
-        /* change the sector status to EMPTY and USING when write begin sector start address */
-        result = write_sector_status(write_addr, SECTOR_STATUS_EMPUT);
-        result = write_sector_status(write_addr, SECTOR_STATUS_USING);
-        if (result == EF_NO_ERR) {
-            write_addr += LOG_SECTOR_HEADER_SIZE;
-        } else {
-            goto exit;
-        }
+        log_end_addr = write_addr;
         /* calculate current sector writable data size */
         writable_size = EF_ERASE_MIN_SIZE - LOG_SECTOR_HEADER_SIZE;
         if (size - write_size >= writable_size) {
@@ -671,13 +869,13 @@ EfErrCode ef_log_write(const uint32_t *log, size_t size) {
             if (result != EF_NO_ERR) {
                 goto exit;
             }
+            log_end_addr = write_addr + writable_size;
+            write_size += writable_size;
             /* change the current sector status to FULL */
             result = write_sector_status(write_addr, SECTOR_STATUS_FULL);
             if (result != EF_NO_ERR) {
                 goto exit;
             }
-            log_end_addr = write_addr + writable_size;
-            write_size += writable_size;
             write_addr += writable_size;
         } else {
             result = ef_port_write(write_addr, log + write_size / 4, size - write_size);
@@ -685,14 +883,597 @@ EfErrCode ef_log_write(const uint32_t *log, size_t size) {
                 goto exit;
             }
             log_end_addr = write_addr + (size - write_size);
+            write_size = size;
             break;
         }
     }
 
 exit:
+    if (written) {
+        *written = write_size;
+    }
+
     return result;
 }
 
+#ifdef EF_LOG_WRITE_BUF_SIZE
+/**
+ * Get the staging buffer capacity for current flash write address.
+ * The staging buffer will be flushed when the data reaches the page (EF_LOG_WRITE_BUF_SIZE) boundary on flash.
+ *
+ * @return the staging buffer capacity
+ */
+static size_t log_buf_capacity(void) {
+    if (log_end_addr % EF_ERASE_MIN_SIZE == 0) {
+        /* the current sector is full, the data will be written behind the next sector header */
+        return EF_LOG_WRITE_BUF_SIZE - LOG_SECTOR_HEADER_SIZE;
+    } else {
+        return EF_LOG_WRITE_BUF_SIZE - log_end_addr % EF_LOG_WRITE_BUF_SIZE;
+    }
+}
+#endif /* EF_LOG_WRITE_BUF_SIZE */
+
+/**
+ * Write log to flash. The log will be put into the staging buffer first when it's enabled (EF_LOG_WRITE_BUF_SIZE),
+ * and it's written to flash when the buffer is full, the latency is expired or ef_log_flush() is called.
+ *
+ * @param log the log which will be write to flash
+ * @param size write bytes size
+ *
+ * @return result
+ */
+EfErrCode ef_log_write(const uint32_t *log, size_t size) {
+    EfErrCode result = EF_NO_ERR;
+#ifdef EF_LOG_WRITE_BUF_SIZE
+    size_t copy_size;
+#endif
+
+    EF_ASSERT(size % 4 == 0);
+    /* must be call this function after initialize OK */
+    if (!init_ok) {
+        return EF_ENV_INIT_FAILED;
+    }
+
+#ifdef EF_LOG_WRITE_BUF_SIZE
+    while (size && result == EF_NO_ERR) {
+#ifdef EF_LOG_WRITE_BUF_LATENCY
+        if (log_buf_len == 0) {
+            log_buf_tick = EF_LOG_GET_TICK();
+        }
+#endif
+        /* fill the staging buffer to the page boundary */
+        copy_size = log_buf_capacity() - log_buf_len;
+        if (copy_size > size) {
+            copy_size = size;
+        }
+        memcpy((uint8_t *)log_buf + log_buf_len, log, copy_size);
+        log_buf_len += copy_size;
+        log += copy_size / 4;
+        size -= copy_size;
+        if (log_buf_len >= log_buf_capacity()) {
+            result = ef_log_flush();
+        }
+    }
+    if (result == EF_NO_ERR) {
+        result = ef_log_flush_expired();
+    }
+#else
+    result = log_write(log, size, NULL);
+#endif /* EF_LOG_WRITE_BUF_SIZE */
+
+    return result;
+}
+
+/**
+ * Flush the logs on staging buffer to flash.
+ *
+ * @return result
+ */
+EfErrCode ef_log_flush(void) {
+    EfErrCode result = EF_NO_ERR;
+#ifdef EF_LOG_WRITE_BUF_SIZE
+    size_t write_size;
+#endif
+
+    /* must be call this function after initialize OK */
+    if (!init_ok) {
+        return EF_ENV_INIT_FAILED;
+    }
+
+#ifdef EF_LOG_WRITE_BUF_SIZE
+    if (log_buf_len) {
+        result = log_write(log_buf, log_buf_len, &write_size);
+        /* the logs which are NOT written are kept on staging buffer, they will be written on next flush */
+        log_buf_len -= write_size;
+        memmove(log_buf, (uint8_t *)log_buf + write_size, log_buf_len);
+    }
+#endif
+
+    return result;
+}
+
+/**
+ * Flush the logs on staging buffer to flash when they have been kept longer than EF_LOG_WRITE_BUF_LATENCY.
+ * It can be called periodically by a tick or idle hook, so the buffered logs will NOT be held when no new log comes.
+ *
+ * @note it does nothing when EF_LOG_WRITE_BUF_LATENCY is NOT defined
+ *
+ * @return result
+ */
+EfErrCode ef_log_flush_expired(void) {
+    EfErrCode result = EF_NO_ERR;
+
+    /* must be call this function after initialize OK */
+    if (!init_ok) {
+        return EF_ENV_INIT_FAILED;
+    }
+
+#if defined(EF_LOG_WRITE_BUF_SIZE) && defined(EF_LOG_WRITE_BUF_LATENCY)
+    if (log_buf_len && EF_LOG_GET_TICK() - log_buf_tick >= EF_LOG_WRITE_BUF_LATENCY) {
+        result = ef_log_flush();
+    }
+#endif
+
+    return result;
+}
+
+/**
+ * Flush the logs on staging buffer to flash in emergency, such as the power brown-out interrupt.
+ * It only writes the logs to the erased area of current sector, so NO sector will be erased.
+ * The logs which are NOT written will be kept on staging buffer.
+ *
+ * @note it can NOT be called when the other log API is running
+ *
+ * @return result
+ */
+EfErrCode ef_log_flush_emergency(void) {
+    EfErrCode result = EF_NO_ERR;
+#ifdef EF_LOG_WRITE_BUF_SIZE
+    size_t write_size;
+
+    /* must be call this function after initialize OK */
+    if (!init_ok) {
+        return EF_ENV_INIT_FAILED;
+    }
+
+    if (log_end_addr % EF_ERASE_MIN_SIZE == 0) {
+        /* the current sector is full, the next sector must be erased */
+        return result;
+    }
+    /* keep 1 word erased, so the sector will NOT be full without FULL status */
+    write_size = EF_ERASE_MIN_SIZE - log_end_addr % EF_ERASE_MIN_SIZE - 4;
+    if (write_size > log_buf_len) {
+        write_size = log_buf_len;
+    }
+    if (write_size) {
+        result = ef_port_write(log_end_addr, log_buf, write_size);
+        if (result == EF_NO_ERR) {
+            log_end_addr += write_size;
+            log_buf_len -= write_size;
+            memmove(log_buf, (uint8_t *)log_buf + write_size, log_buf_len);
+        }
+    }
+#endif /* EF_LOG_WRITE_BUF_SIZE */
+
+    return result;
+}
+
+#ifdef EF_LOG_RING_SIZE
+/**
+ * Lock-free add the value to the counter.
+ *
+ * @param counter the counter
+ * @param value add value
+ */
+static void log_ring_atomic_add(volatile uint32_t *counter, uint32_t value) {
+    uint32_t old;
+
+    do {
+        old = *counter;
+    } while (!EF_LOG_ATOMIC_CAS(counter, old, old + value));
+}
+#endif /* EF_LOG_RING_SIZE */
+
+/**
+ * Put log to the log ring. It's lock-free and never blocked, so it can be called by multiple tasks and ISRs.
+ * The log will be written to flash when ef_log_ring_drain() is called.
+ *
+ * @param log the log which will be put to the log ring
+ * @param size log bytes size, it must be word aligned
+ *
+ * @return result, it's EF_WRITE_ERR when the ring has NO enough space and the log is dropped
+ */
+EfErrCode ef_log_ring_write(const uint32_t *log, size_t size) {
+#ifdef EF_LOG_RING_SIZE
+    uint32_t head, tail, new_head, used, high_water;
+    size_t i;
+
+    EF_ASSERT(size % 4 == 0);
+
+    /* reserve the space by moving the head */
+    do {
+        head = log_ring_head;
+        tail = log_ring_tail;
+        new_head = head + LOG_RING_HDR_SIZE + size;
+        if (size == 0 || new_head - tail > EF_LOG_RING_SIZE) {
+            log_ring_atomic_add(&log_ring_dropped, 1);
+            log_ring_atomic_add(&log_ring_dropped_bytes, size);
+            return EF_WRITE_ERR;
+        }
+    } while (!EF_LOG_ATOMIC_CAS(&log_ring_head, head, new_head));
+    /* record the high water mark */
+    used = new_head - tail;
+    do {
+        high_water = log_ring_high_water;
+    } while (used > high_water && !EF_LOG_ATOMIC_CAS(&log_ring_high_water, high_water, used));
+    /* the reserved space has been cleared by consumer, copy the log behind the header */
+    for (i = 0; i < size / 4; i++) {
+        log_ring[(head / 4 + 1 + i) & LOG_RING_WORD_MASK] = log[i];
+    }
+    EF_LOG_MEMORY_BARRIER();
+    /* commit the record */
+    log_ring[(head / 4) & LOG_RING_WORD_MASK] = LOG_RING_HDR_COMMITTED | size;
+
+    return EF_NO_ERR;
+#else
+    return ef_log_write(log, size);
+#endif /* EF_LOG_RING_SIZE */
+}
+
+/**
+ * Drain the committed logs on log ring to flash. The logs are written by ef_log_write() in order,
+ * it will stop at the first record which is reserved but NOT committed.
+ * @note it must be called by only one consumer, such as a log task or the idle hook
+ *
+ * @return result
+ */
+EfErrCode ef_log_ring_drain(void) {
+    EfErrCode result = EF_NO_ERR;
+#ifdef EF_LOG_RING_SIZE
+    uint32_t tail = log_ring_tail, hdr, index;
+    size_t size, part_size, i;
+
+    /* must be call this function after initialize OK */
+    if (!init_ok) {
+        return EF_ENV_INIT_FAILED;
+    }
+
+    while (tail != log_ring_head && result == EF_NO_ERR) {
+        hdr = log_ring[(tail / 4) & LOG_RING_WORD_MASK];
+        if (!(hdr & LOG_RING_HDR_COMMITTED)) {
+            /* the record is still writing by producer */
+            break;
+        }
+        EF_LOG_MEMORY_BARRIER();
+        size = hdr & ~LOG_RING_HDR_COMMITTED;
+        index = (tail / 4 + 1) & LOG_RING_WORD_MASK;
+        /* the record maybe wrapped to the ring head */
+        part_size = (EF_LOG_RING_SIZE / 4 - index) * 4;
+        if (part_size >= size) {
+            result = ef_log_write(&log_ring[index], size);
+        } else {
+            result = ef_log_write(&log_ring[index], part_size);
+            if (result == EF_NO_ERR) {
+                result = ef_log_write(&log_ring[0], size - part_size);
+            }
+        }
+        if (result != EF_NO_ERR) {
+            break;
+        }
+        /* clear the record, so the next record on this space is NOT committed until the producer commits it */
+        for (i = 0; i < (LOG_RING_HDR_SIZE + size) / 4; i++) {
+            log_ring[(tail / 4 + i) & LOG_RING_WORD_MASK] = 0;
+        }
+        EF_LOG_MEMORY_BARRIER();
+        tail += LOG_RING_HDR_SIZE + size;
+        log_ring_tail = tail;
+    }
+#endif /* EF_LOG_RING_SIZE */
+
+    return result;
+}
+
+/**
+ * Get the log ring statistics, it's useful to adjust the log ring size (EF_LOG_RING_SIZE).
+ * The statistics will be all 0 when the log ring is disabled.
+ *
+ * @param stats the statistics
+ */
+void ef_get_log_ring_stats(log_ring_stats_t stats) {
+    EF_ASSERT(stats);
+
+#ifdef EF_LOG_RING_SIZE
+    stats->size = EF_LOG_RING_SIZE;
+    stats->used = log_ring_head - log_ring_tail;
+    stats->high_water = log_ring_high_water;
+    stats->dropped = log_ring_dropped;
+    stats->dropped_bytes = log_ring_dropped_bytes;
+#else
+    memset(stats, 0x00, sizeof(struct log_ring_stats));
+#endif /* EF_LOG_RING_SIZE */
+}
+
+#ifdef EF_LOG_USING_RECORD
+/**
+ * Write a record to log. The record has the data length, CRC32 and sequence number, @see ef_log_iter_next
+ *
+ * @param data record data
+ * @param size record data size, it's NOT required to be word aligned, and it must be less than 64KB
+ *
+ * @return result
+ */
+EfErrCode ef_log_record_write(const void *data, size_t size) {
+    EfErrCode result = EF_NO_ERR;
+    uint32_t buf[LOG_RECORD_BUF_WORDS];
+    size_t buf_len, copy_size, i;
+
+    EF_ASSERT(data || !size);
+    /* must be call this function after initialize OK */
+    if (!init_ok) {
+        return EF_ENV_INIT_FAILED;
+    }
+    if (size > LOG_RECORD_DATA_MAX || LOG_RECORD_SIZE(size) > ef_log_get_total_size()) {
+        EF_DEBUG("Error: The log record size (%d) is too large.\n", size);
+        return EF_WRITE_ERR;
+    }
+
+    buf[0] = (uint32_t) LOG_RECORD_MAGIC << 16 | size;
+    buf[1] = log_record_seq;
+    buf[2] = ef_calc_crc32(ef_calc_crc32(0, buf, 8), data, size);
+    buf_len = LOG_RECORD_HDR_SIZE;
+    /* the record is written by buffer size */
+    for (i = 0; i < size && result == EF_NO_ERR; i += copy_size) {
+        copy_size = sizeof(buf) - buf_len;
+        if (copy_size > size - i) {
+            copy_size = size - i;
+        }
+        memcpy((uint8_t *)buf + buf_len, (const uint8_t *)data + i, copy_size);
+        buf_len += copy_size;
+        if (buf_len == sizeof(buf)) {
+            result = ef_log_write(buf, buf_len);
+            buf_len = 0;
+        }
+    }
+    if (result == EF_NO_ERR) {
+        /* padding the data and write the tail */
+        memset((uint8_t *)buf + buf_len, 0x00, (4 - buf_len % 4) % 4);
+        buf_len = (buf_len + 3) / 4 * 4;
+        if (buf_len == sizeof(buf)) {
+            result = ef_log_write(buf, buf_len);
+            buf_len = 0;
+        }
+        buf[buf_len / 4] = (uint32_t) LOG_RECORD_MAGIC << 16 | size;
+        buf_len += LOG_RECORD_TAIL_SIZE;
+        if (result == EF_NO_ERR) {
+            result = ef_log_write(buf, buf_len);
+        }
+    }
+    if (result == EF_NO_ERR) {
+        log_record_seq++;
+    }
+
+    return result;
+}
+
+/**
+ * Check the record on log index is valid, the current record of iterator will be set when it's valid.
+ *
+ * @param index record start index on log
+ * @param used_size log used size
+ * @param itr iterator
+ *
+ * @return true: the record is valid
+ */
+static bool log_record_check(size_t index, size_t used_size, log_iterator_obj_t itr) {
+    uint32_t hdr[LOG_RECORD_HDR_SIZE / 4], buf[LOG_RECORD_BUF_WORDS], tail, crc32;
+    size_t len, read_size, i;
+
+    if (index + LOG_RECORD_HDR_SIZE + LOG_RECORD_TAIL_SIZE > used_size) {
+        return false;
+    }
+    ef_log_read(index, hdr, sizeof(hdr));
+    len = hdr[0] & 0xFFFF;
+    if ((hdr[0] >> 16) != LOG_RECORD_MAGIC || index + LOG_RECORD_SIZE(len) > used_size) {
+        return false;
+    }
+    ef_log_read(index + LOG_RECORD_SIZE(len) - LOG_RECORD_TAIL_SIZE, &tail, sizeof(tail));
+    if (tail != hdr[0]) {
+        return false;
+    }
+    crc32 = ef_calc_crc32(0, hdr, 8);
+    for (i = 0; i < len; i += read_size) {
+        read_size = len - i < sizeof(buf) ? len - i : sizeof(buf);
+        ef_log_read(index + LOG_RECORD_HDR_SIZE + i, buf, (read_size + 3) / 4 * 4);
+        crc32 = ef_calc_crc32(crc32, buf, read_size);
+    }
+    if (crc32 != hdr[2]) {
+        return false;
+    }
+    itr->index = index;
+    itr->len = len;
+    itr->seq = hdr[1];
+
+    return true;
+}
+
+/**
+ * Find the first valid record which starts at or after the log index.
+ * The invalid data (such as the torn record by power down) will be skipped.
+ *
+ * @param index find start index
+ * @param used_size log used size
+ * @param itr iterator, the current record will be set when it's found
+ *
+ * @return true: found
+ */
+static bool log_record_find_next(size_t index, size_t used_size, log_iterator_obj_t itr) {
+    uint32_t buf[LOG_RECORD_BUF_WORDS];
+    size_t read_size, i;
+
+    while (index + LOG_RECORD_HDR_SIZE + LOG_RECORD_TAIL_SIZE <= used_size) {
+        read_size = used_size - index < sizeof(buf) ? used_size - index : sizeof(buf);
+        ef_log_read(index, buf, read_size);
+        for (i = 0; i < read_size / 4; i++) {
+            if ((buf[i] >> 16) == LOG_RECORD_MAGIC && log_record_check(index + i * 4, used_size, itr)) {
+                return true;
+            }
+        }
+        index += read_size;
+    }
+
+    return false;
+}
+
+/**
+ * Find the last valid record which ends at or before the log index. It finds the record tail backward.
+ *
+ * @param index find start index
+ * @param min_index the record which ends at or before this index will NOT be found
+ * @param used_size log used size
+ * @param itr iterator, the current record will be set when it's found
+ *
+ * @return true: found
+ */
+static bool log_record_find_prev(size_t index, size_t min_index, size_t used_size, log_iterator_obj_t itr) {
+    uint32_t buf[LOG_RECORD_BUF_WORDS];
+    size_t read_size, end, i;
+
+    while (index > min_index && index >= LOG_RECORD_HDR_SIZE + LOG_RECORD_TAIL_SIZE) {
+        read_size = index - min_index < sizeof(buf) ? index - min_index : sizeof(buf);
+        ef_log_read(index - read_size, buf, read_size);
+        for (i = read_size / 4; i > 0; i--) {
+            end = index - read_size + i * 4;
+            if ((buf[i - 1] >> 16) == LOG_RECORD_MAGIC && LOG_RECORD_SIZE(buf[i - 1] & 0xFFFF) <= end
+                    && log_record_check(end - LOG_RECORD_SIZE(buf[i - 1] & 0xFFFF), used_size, itr)
+                    && itr->len == (buf[i - 1] & 0xFFFF)) {
+                /* the found record must be end at the tail */
+                return true;
+            }
+        }
+        index -= read_size;
+    }
+
+    return false;
+}
+
+/**
+ * Initialize the log record iterator.
+ * @note the iterator is invalid after the log is written, because the oldest log maybe dropped, @see ef_log_iter_seek
+ *
+ * @param itr iterator
+ * @param from_newest false: iterate from the oldest record by ef_log_iter_next
+ *                    true: iterate from the newest record by ef_log_iter_prev
+ *
+ * @return iterator
+ */
+log_iterator_obj_t ef_log_iter_init(log_iterator_obj_t itr, bool from_newest) {
+    EF_ASSERT(itr);
+
+    itr->cursor = from_newest ? ef_log_get_used_size() : 0;
+    itr->index = 0;
+    itr->len = 0;
+    itr->seq = 0;
+
+    return itr;
+}
+
+/**
+ * Iterate to the next (newer) record.
+ *
+ * @param itr iterator
+ *
+ * @return true: the current record of iterator is valid, false: there has NO more record
+ */
+bool ef_log_iter_next(log_iterator_obj_t itr) {
+    EF_ASSERT(itr);
+
+    if (log_record_find_next(itr->cursor, ef_log_get_used_size(), itr)) {
+        itr->cursor = itr->index + LOG_RECORD_SIZE(itr->len);
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Iterate to the previous (older) record.
+ *
+ * @param itr iterator
+ *
+ * @return true: the current record of iterator is valid, false: there has NO more record
+ */
+bool ef_log_iter_prev(log_iterator_obj_t itr) {
+    EF_ASSERT(itr);
+
+    if (log_record_find_prev(itr->cursor, 0, ef_log_get_used_size(), itr)) {
+        itr->cursor = itr->index;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Seek the iterator to the first record which sequence number is greater than or equal to the input.
+ * The sequence numbers are increasing on log, so it's found by binary search.
+ * The found record will be the next record of ef_log_iter_next.
+ *
+ * @param itr iterator
+ * @param seq sequence number
+ *
+ * @return true: found
+ */
+bool ef_log_iter_seek(log_iterator_obj_t itr, uint32_t seq) {
+    struct log_iterator_obj record;
+    size_t used_size = ef_log_get_used_size(), low = 0, high = used_size / 4, mid;
+
+    EF_ASSERT(itr);
+
+    /* find the smallest word index which the first record at or after it is NOT older than the sequence number */
+    while (low < high) {
+        mid = (low + high) / 2;
+        if (log_record_find_next(mid * 4, used_size, &record) && (int32_t) (record.seq - seq) < 0) {
+            low = record.index / 4 + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (log_record_find_next(low * 4, used_size, itr)) {
+        itr->cursor = itr->index;
+        return true;
+    }
+    itr->cursor = used_size;
+
+    return false;
+}
+
+/**
+ * Read the current record data of iterator.
+ *
+ * @param itr iterator
+ * @param buf data buffer
+ * @param size data buffer size
+ *
+ * @return the read data length, it's the less one of record data length and buffer size
+ */
+size_t ef_log_iter_read(log_iterator_obj_t itr, void *buf, size_t size) {
+    uint32_t words[LOG_RECORD_BUF_WORDS];
+    size_t read_len, read_size, i;
+
+    EF_ASSERT(itr);
+    EF_ASSERT(buf);
+
+    read_len = size < itr->len ? size : itr->len;
+    for (i = 0; i < read_len; i += read_size) {
+        read_size = read_len - i < sizeof(words) ? read_len - i : sizeof(words);
+        ef_log_read(itr->index + LOG_RECORD_HDR_SIZE + i, words, (read_size + 3) / 4 * 4);
+        memcpy((uint8_t *)buf + i, words, read_size);
+    }
+
+    return read_len;
+}
+#endif /* EF_LOG_USING_RECORD */
+
 /**
  * Get next flash sector address.The log total sector like ring buffer which implement by flash.
  *
@@ -712,6 +1493,61 @@ static uint32_t get_next_flash_sec_addr(uint32_t cur_addr) {
     }
 }
 
+/**
+ * Get the flash sector address which is offset sectors after current sector. The log sectors are a ring.
+ *
+ * @param cur_addr cur flash address
+ * @param offset sector offset
+ *
+ * @return the flash sector address
+ */
+static uint32_t get_offset_flash_sec_addr(uint32_t cur_addr, size_t offset) {
+    size_t cur_sec_id = (cur_addr - log_area_start_addr) / EF_ERASE_MIN_SIZE;
+    size_t sec_total_num = LOG_AREA_SIZE / EF_ERASE_MIN_SIZE;
+
+    return log_area_start_addr + (cur_sec_id + offset) % sec_total_num * EF_ERASE_MIN_SIZE;
+}
+
+/**
+ * Pre-erase the sectors (EF_LOG_PRE_ERASE_SEC_NUM) after current USING sector, so the ef_log_write will only program
+ * the flash when it moves to next sector. It can be called on the idle hook or a low priority task.
+ * @note the oldest logs on the pre-erased sectors will be dropped, and it can NOT be called when ef_log_write is running
+ *
+ * @return result
+ */
+EfErrCode ef_log_pre_erase(void) {
+    EfErrCode result = EF_NO_ERR;
+    uint32_t using_sec_addr, sec_addr, seq;
+    size_t i;
+
+    /* must be call this function after initialize OK */
+    if (!init_ok) {
+        return EF_ENV_INIT_FAILED;
+    }
+
+    using_sec_addr = (log_end_addr - 4) & (~(EF_ERASE_MIN_SIZE - 1));
+    for (i = 1; i <= EF_LOG_PRE_ERASE_SEC_NUM && result == EF_NO_ERR; i++) {
+        sec_addr = get_offset_flash_sec_addr(using_sec_addr, i);
+        if (sec_addr == using_sec_addr) {
+            break;
+        }
+        if (get_sector_info(sec_addr, &seq) == SECTOR_STATUS_EMPUT && seq == 0xFFFFFFFF) {
+            /* it's already erased */
+            continue;
+        }
+        /* move the flash log start address when the oldest logs sector will be erased */
+        if (log_start_addr == sec_addr) {
+            log_start_addr = get_next_flash_sec_addr(log_start_addr);
+        }
+        result = ef_port_erase(sec_addr, EF_ERASE_MIN_SIZE);
+        if (result == EF_NO_ERR) {
+            result = write_sector_status(sec_addr, SECTOR_STATUS_EMPUT);
+        }
+    }
+
+    return result;
+}
+
 /**
  * Clean all log which in flash.
  *
@@ -721,6 +1557,10 @@ EfErrCode ef_log_clean(void) {
     EfErrCode result = EF_NO_ERR;
     uint32_t write_addr = log_area_start_addr;
 
+#ifdef EF_LOG_WRITE_BUF_SIZE
+    /* the logs on staging buffer are cleaned too */
+    log_buf_len = 0;
+#endif
     /* clean address */
     log_start_addr = log_area_start_addr;
     log_end_addr = log_start_addr + LOG_SECTOR_HEADER_SIZE;
@@ -730,15 +1570,21 @@ EfErrCode ef_log_clean(void) {
         goto exit;
     }
     /* setting first sector is EMPTY to USING */
-    write_sector_status(write_addr, SECTOR_STATUS_EMPUT);
-    write_sector_status(write_addr, SECTOR_STATUS_USING);
+    log_sec_seq = 0;
+    result = write_sector_status(write_addr, SECTOR_STATUS_EMPUT);
+    if (result == EF_NO_ERR) {
+        result = write_sector_seq(write_addr, log_sec_seq);
+    }
+    if (result == EF_NO_ERR) {
+        result = write_sector_status(write_addr, SECTOR_STATUS_USING);
+    }
     if (result != EF_NO_ERR) {
         goto exit;
     }
     write_addr += EF_ERASE_MIN_SIZE;
     /* add sector header */
     while (true) {
-        write_sector_status(write_addr, SECTOR_STATUS_EMPUT);
+        result = write_sector_status(write_addr, SECTOR_STATUS_EMPUT);
         if (result != EF_NO_ERR) {
             goto exit;
         }